@@ -0,0 +1,173 @@
+#include <stdlib.h>
+#include <stdint.h>
+
+#include "arena.h"
+
+#define ARENA_ALIGNMENT _Alignof(max_align_t)
+
+_Static_assert(sizeof(struct arena_block) % ARENA_ALIGNMENT == 0, "the data of a block must be aligned");
+
+
+/******************************************************************************/
+/* ARENA                                                                      */
+
+/**
+ * @brief Initializes an empty arena. No memory is allocated until the first allocation.
+ * @param arena The arena.
+ * @param block_size The minimum size of its blocks.
+ */
+void init_arena(struct arena *arena, size_t block_size) {
+  arena->blocks = NULL;
+  arena->block_size = block_size;
+  arena->used = 0;
+  arena->peak = 0;
+  arena->allocations = 0;
+  arena->heap_allocations = 0;
+}
+
+
+/**
+ * @brief Allocates a block from the heap and puts it in front of the blocks of the arena.
+ * @param arena The arena.
+ * @param size The size of the data of the block.
+ * @return struct arena_block* The block, or `NULL` if there is no memory.
+ */
+struct arena_block *add_arena_block(struct arena *arena, size_t size) {
+  struct arena_block *block = malloc(sizeof(struct arena_block) + size);
+
+  if (!block)
+    return NULL;
+
+  block->next = arena->blocks;
+  block->size = size;
+  block->used = 0;
+  block->data = (unsigned char *) (block + 1);
+  arena->blocks = block;
+  arena->heap_allocations++;
+
+  return block;
+}
+
+
+/**
+ * @brief Allocates memory from an arena, aligned for any type.
+ * @details Only the first block has room left, the others are full: a new block is as large as the arena so far, so
+ * that the blocks grow geometrically.
+ * @param arena The arena.
+ * @param size The size of the memory.
+ * @return void* The memory, or `NULL` if there is no memory.
+ */
+void *arena_alloc(struct arena *arena, size_t size) {
+  struct arena_block *block = arena->blocks;
+
+  size = (size + ARENA_ALIGNMENT - 1) & ~(size_t) (ARENA_ALIGNMENT - 1);
+
+  if (!block || block->size - block->used < size) {
+    size_t block_size = arena->used > arena->block_size ? arena->used : arena->block_size;
+
+    block = add_arena_block(arena, size > block_size ? size : block_size);
+
+    if (!block)
+      return NULL;
+  }
+
+  void *memory = block->data + block->used;
+
+  block->used += size;
+  arena->used += size;
+  arena->allocations++;
+
+  if (arena->used > arena->peak)
+    arena->peak = arena->used;
+
+  return memory;
+}
+
+
+/**
+ * @brief Gives back all the memory of an arena at once. When the memory was spread over more blocks, they are replaced
+ * by a single one, large enough for the most memory ever used.
+ * @param arena The arena.
+ */
+void arena_reset(struct arena *arena) {
+  struct arena_block *block = arena->blocks;
+
+  if (block && block->next) {
+    free_arena(arena);
+
+    // When there is no memory, the block is allocated again when needed.
+    add_arena_block(arena, arena->peak);
+  } else if (block) {
+    block->used = 0;
+  }
+
+  arena->used = 0;
+}
+
+
+/**
+ * @brief Gives back the blocks of an arena to the heap. The arena can still be used, and keeps its counters.
+ * @param arena The arena.
+ */
+void free_arena(struct arena *arena) {
+  struct arena_block *block = arena->blocks;
+
+  while (block) {
+    struct arena_block *next = block->next;
+
+    free(block);
+    block = next;
+  }
+
+  arena->blocks = NULL;
+  arena->used = 0;
+}
+
+
+/******************************************************************************/
+/* POOL                                                                       */
+
+/**
+ * @brief Initializes an empty pool.
+ * @param pool The pool.
+ * @param arena The arena of the items.
+ * @param item_size The size of the items, at least the one of a pointer, since the free items are linked together.
+ */
+void init_pool(struct pool *pool, struct arena *arena, size_t item_size) {
+  pool->arena = arena;
+  pool->item_size = item_size > sizeof(void *) ? item_size : sizeof(void *);
+  pool->free_items = NULL;
+  pool->allocations = 0;
+  pool->reuses = 0;
+}
+
+
+/**
+ * @brief Takes an item from the pool, reusing one given back if any.
+ * @param pool The pool.
+ * @return void* The item, or `NULL` if there is no memory.
+ */
+void *pool_alloc(struct pool *pool) {
+  void *item = pool->free_items;
+
+  pool->allocations++;
+
+  if (!item)
+    return arena_alloc(pool->arena, pool->item_size);
+
+  pool->free_items = *(void **) item;
+  pool->reuses++;
+
+  return item;
+}
+
+
+/**
+ * @brief Gives an item back to the pool.
+ * @param pool The pool.
+ * @param item The item.
+ */
+void pool_free(struct pool *pool, void *item) {
+  *(void **) item = pool->free_items;
+  pool->free_items = item;
+}
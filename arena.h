@@ -0,0 +1,51 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <stddef.h>
+
+
+/**
+ * A bump allocator: memory is taken from the end of a block and only given back all at once, by `arena_reset()`. When
+ * a block is full another one is allocated; on reset they are replaced by a single block as large as all of them, so
+ * once the arena has seen its largest use it never allocates from the heap again.
+ * The counters tell the allocations served, the ones which went to the heap, and the most bytes used between resets.
+ */
+struct arena_block {
+  struct arena_block *next;
+  size_t size;
+  size_t used;
+  unsigned char *data;
+};
+
+struct arena {
+  struct arena_block *blocks;
+  size_t block_size;
+  size_t used;
+  size_t peak;
+  long long allocations;
+  long long heap_allocations;
+};
+
+/**
+ * A pool of items of the same size, taken from an arena. The items given back are kept in a list and handed out again
+ * before the arena is touched. The pool is emptied with its arena, and must be initialized again after a reset.
+ */
+struct pool {
+  struct arena *arena;
+  size_t item_size;
+  void *free_items;
+  long long allocations;
+  long long reuses;
+};
+
+
+void init_arena(struct arena *arena, size_t block_size);
+void *arena_alloc(struct arena *arena, size_t size);
+void arena_reset(struct arena *arena);
+void free_arena(struct arena *arena);
+
+void init_pool(struct pool *pool, struct arena *arena, size_t item_size);
+void *pool_alloc(struct pool *pool);
+void pool_free(struct pool *pool, void *item);
+
+#endif
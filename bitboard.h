@@ -0,0 +1,456 @@
+#ifndef BITBOARD_H
+#define BITBOARD_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#define BITBOARD_ROWS 16
+#define BITBOARD_COLUMNS 8
+
+
+/**
+ * A set of cells of the grid packed in 128 bits, one 16-bit word per column. Bit `r` of `column[c]` is the cell at
+ * row `r` and column `c`, so the first row of the grid is the least significant bit of every column.
+ */
+typedef union {
+  uint16_t column[BITBOARD_COLUMNS];
+  uint64_t word[2];
+} bitboard;
+
+
+/**
+ * @brief Returns the index of the least significant bit set in `bits`, which must not be zero.
+ */
+static inline int bb_ctz(uint32_t bits) {
+#if defined(__GNUC__)
+  return __builtin_ctz(bits);
+#else
+  int i = 0;
+  while (!((bits >> i) & 1))
+    i++;
+  return i;
+#endif
+}
+
+
+/**
+ * @brief Returns the number of bits set in `bits`, such as the cells of a column.
+ */
+static inline int bb_popcount(uint32_t bits) {
+#if defined(__GNUC__)
+  return __builtin_popcount(bits);
+#else
+  int count = 0;
+  for (; bits; bits &= bits - 1)
+    count++;
+  return count;
+#endif
+}
+
+
+/**
+ * @brief Returns the index of the least significant bit set in a word of a bitboard, which must not be zero.
+ */
+static inline int bb_ctz64(uint64_t bits) {
+#if defined(__GNUC__)
+  return __builtin_ctzll(bits);
+#else
+  int i = 0;
+  while (!((bits >> i) & 1))
+    i++;
+  return i;
+#endif
+}
+
+
+/**
+ * @brief Returns an empty set of cells.
+ */
+static inline bitboard bb_zero(void) {
+  bitboard b = { { 0 } };
+  return b;
+}
+
+
+/**
+ * @brief Returns the set of all the cells of the grid.
+ */
+static inline bitboard bb_full(void) {
+  bitboard b;
+  b.word[0] = b.word[1] = UINT64_MAX;
+  return b;
+}
+
+
+/**
+ * @brief Returns the set of all the cells of a row.
+ */
+static inline bitboard bb_row(int row) {
+  bitboard b;
+
+  for (int c = 0; c < BITBOARD_COLUMNS; c++)
+    b.column[c] = (uint16_t)(1u << row);
+
+  return b;
+}
+
+
+/**
+ * @brief Returns `true` if the cell at the coordinates (row, column) belongs to the set.
+ */
+static inline bool bb_test(bitboard b, int row, int column) {
+  return (b.column[column] >> row) & 1;
+}
+
+
+/**
+ * @brief Adds the cell at the coordinates (row, column) to the set.
+ */
+static inline void bb_set(bitboard *b, int row, int column) {
+  b->column[column] |= (uint16_t)(1u << row);
+}
+
+
+/**
+ * @brief Removes the cell at the coordinates (row, column) from the set.
+ */
+static inline void bb_reset(bitboard *b, int row, int column) {
+  b->column[column] &= (uint16_t)~(1u << row);
+}
+
+
+static inline bitboard bb_or(bitboard a, bitboard b) {
+  a.word[0] |= b.word[0];
+  a.word[1] |= b.word[1];
+  return a;
+}
+
+
+static inline bitboard bb_and(bitboard a, bitboard b) {
+  a.word[0] &= b.word[0];
+  a.word[1] &= b.word[1];
+  return a;
+}
+
+
+static inline bitboard bb_xor(bitboard a, bitboard b) {
+  a.word[0] ^= b.word[0];
+  a.word[1] ^= b.word[1];
+  return a;
+}
+
+
+/**
+ * @brief Returns the cells of `a` which do not belong to `b`.
+ */
+static inline bitboard bb_andnot(bitboard a, bitboard b) {
+  a.word[0] &= ~b.word[0];
+  a.word[1] &= ~b.word[1];
+  return a;
+}
+
+
+/**
+ * @brief Returns `true` if the set contains at least one cell.
+ */
+static inline bool bb_any(bitboard b) {
+  return (b.word[0] | b.word[1]) != 0;
+}
+
+
+static inline bool bb_equal(bitboard a, bitboard b) {
+  return a.word[0] == b.word[0] && a.word[1] == b.word[1];
+}
+
+
+/**
+ * @brief Returns the number of cells in the set.
+ */
+static inline int bb_count(bitboard b) {
+#if defined(__GNUC__)
+  return __builtin_popcountll(b.word[0]) + __builtin_popcountll(b.word[1]);
+#else
+  int count = 0;
+  for (int i = 0; i < 2; i++)
+    for (uint64_t w = b.word[i]; w; w &= w - 1)
+      count++;
+  return count;
+#endif
+}
+
+
+/**
+ * @brief Returns the first row below `row` where the column holds a cell of the set, or `BITBOARD_ROWS` if there is
+ * none. `row` can be `-1` to search the whole column.
+ */
+static inline int bb_next_row(bitboard b, int row, int column) {
+  uint32_t below = (uint32_t) b.column[column] >> (row + 1);
+
+  return below ? row + 1 + bb_ctz(below) : BITBOARD_ROWS;
+}
+
+
+/**
+ * @brief Returns the whole rows crossing at least one cell of the set.
+ */
+static inline bitboard bb_rows(bitboard b) {
+  uint16_t rows = 0;
+
+  for (int c = 0; c < BITBOARD_COLUMNS; c++)
+    rows |= b.column[c];
+
+  for (int c = 0; c < BITBOARD_COLUMNS; c++)
+    b.column[c] = rows;
+
+  return b;
+}
+
+
+/**
+ * @brief Returns the whole columns crossing at least one cell of the set.
+ */
+static inline bitboard bb_columns(bitboard b) {
+  for (int c = 0; c < BITBOARD_COLUMNS; c++)
+    b.column[c] = b.column[c] ? UINT16_MAX : 0;
+
+  return b;
+}
+
+
+/**
+ * @brief Removes the first cell of the set, in column order, and stores its coordinates.
+ * @return bool Returns `false` if the set was already empty.
+ */
+static inline bool bb_pop(bitboard *b, int *row, int *column) {
+  for (int c = 0; c < BITBOARD_COLUMNS; c++) {
+    uint16_t bits = b->column[c];
+
+    if (!bits)
+      continue;
+
+    *row = bb_ctz(bits);
+    *column = c;
+    b->column[c] = (uint16_t)(bits & (bits - 1));
+
+    return true;
+  }
+
+  return false;
+}
+
+
+/******************************************************************************/
+/* SHIFTS                                                                     */
+
+/*
+ * Every shift moves the whole set by one cell. Cells pushed outside the grid are lost and the ones entering it are
+ * empty. The SSE2 versions handle the board as eight 16-bit lanes, one per column.
+ */
+
+#if defined(__SSE2__)
+static inline __m128i bb_load(bitboard b) {
+  return _mm_loadu_si128((const __m128i *) &b);
+}
+
+
+static inline bitboard bb_store(__m128i x) {
+  bitboard b;
+  _mm_storeu_si128((__m128i *) &b, x);
+  return b;
+}
+#endif
+
+
+/**
+ * @brief Moves every cell one row up.
+ */
+static inline bitboard bb_up(bitboard b) {
+#if defined(__SSE2__)
+  return bb_store(_mm_srli_epi16(bb_load(b), 1));
+#else
+  b.word[0] = (b.word[0] >> 1) & UINT64_C(0x7fff7fff7fff7fff);
+  b.word[1] = (b.word[1] >> 1) & UINT64_C(0x7fff7fff7fff7fff);
+  return b;
+#endif
+}
+
+
+/**
+ * @brief Moves every cell one row down.
+ */
+static inline bitboard bb_down(bitboard b) {
+#if defined(__SSE2__)
+  return bb_store(_mm_slli_epi16(bb_load(b), 1));
+#else
+  b.word[0] = (b.word[0] << 1) & UINT64_C(0xfffefffefffefffe);
+  b.word[1] = (b.word[1] << 1) & UINT64_C(0xfffefffefffefffe);
+  return b;
+#endif
+}
+
+
+/**
+ * @brief Moves every cell one column to the left.
+ */
+static inline bitboard bb_left(bitboard b) {
+#if defined(__SSE2__)
+  return bb_store(_mm_srli_si128(bb_load(b), 2));
+#else
+  for (int c = 0; c < BITBOARD_COLUMNS - 1; c++)
+    b.column[c] = b.column[c + 1];
+  b.column[BITBOARD_COLUMNS - 1] = 0;
+  return b;
+#endif
+}
+
+
+/**
+ * @brief Moves every cell one column to the right.
+ */
+static inline bitboard bb_right(bitboard b) {
+#if defined(__SSE2__)
+  return bb_store(_mm_slli_si128(bb_load(b), 2));
+#else
+  for (int c = BITBOARD_COLUMNS - 1; c > 0; c--)
+    b.column[c] = b.column[c - 1];
+  b.column[0] = 0;
+  return b;
+#endif
+}
+
+
+/**
+ * @brief Reflects the set left to right: column `c` goes to column `BITBOARD_COLUMNS - 1 - c`.
+ */
+static inline bitboard bb_mirror(bitboard b) {
+#if defined(__SSE2__)
+  __m128i x = bb_load(b);
+
+  x = _mm_shufflehi_epi16(_mm_shufflelo_epi16(x, 0x1b), 0x1b);
+  return bb_store(_mm_shuffle_epi32(x, 0x4e));
+#else
+  bitboard mirror;
+
+  for (int c = 0; c < BITBOARD_COLUMNS; c++)
+    mirror.column[c] = b.column[BITBOARD_COLUMNS - 1 - c];
+  return mirror;
+#endif
+}
+
+
+/**
+ * @brief Moves the cells of the set which belong to `falling` one row down, leaving the others where they are.
+ */
+static inline bitboard bb_fall(bitboard b, bitboard falling) {
+  return bb_or(bb_andnot(b, falling), bb_down(bb_and(b, falling)));
+}
+
+
+/******************************************************************************/
+/* RUNS                                                                       */
+
+/**
+ * @brief Returns the cells of the set which are part of a horizontal or vertical run of at least `length` cells.
+ * @details A cell starts a run when it survives `length - 1` AND operations with the set shifted towards it, then the
+ * starting cells are spread back over the whole run with as many OR operations.
+ */
+static inline bitboard bb_runs(bitboard b, int length) {
+#if defined(__SSE2__)
+  __m128i cells = bb_load(b);
+  __m128i vertical = cells, horizontal = cells;
+  __m128i up = cells, left = cells;
+
+  for (int i = 1; i < length; i++) {
+    up = _mm_srli_epi16(up, 1);
+    left = _mm_srli_si128(left, 2);
+    vertical = _mm_and_si128(vertical, up);
+    horizontal = _mm_and_si128(horizontal, left);
+  }
+
+  __m128i runs = _mm_or_si128(vertical, horizontal);
+
+  for (int i = 1; i < length; i++) {
+    vertical = _mm_slli_epi16(vertical, 1);
+    horizontal = _mm_slli_si128(horizontal, 2);
+    runs = _mm_or_si128(runs, _mm_or_si128(vertical, horizontal));
+  }
+
+  return bb_store(runs);
+#else
+  bitboard vertical = b, horizontal = b;
+  bitboard up = b, left = b;
+
+  for (int i = 1; i < length; i++) {
+    up = bb_up(up);
+    left = bb_left(left);
+    vertical = bb_and(vertical, up);
+    horizontal = bb_and(horizontal, left);
+  }
+
+  bitboard runs = bb_or(vertical, horizontal);
+
+  for (int i = 1; i < length; i++) {
+    vertical = bb_down(vertical);
+    horizontal = bb_right(horizontal);
+    runs = bb_or(runs, bb_or(vertical, horizontal));
+  }
+
+  return runs;
+#endif
+}
+
+
+#if defined(__AVX2__)
+/**
+ * @brief Same as `bb_runs()`, on two sets at once. Each set takes one 128-bit lane of the register, and its runs are
+ * returned in the same lane.
+ */
+static inline __m256i bb_runs256(__m256i cells, int length) {
+  __m256i vertical = cells, horizontal = cells;
+  __m256i up = cells, left = cells;
+
+  for (int i = 1; i < length; i++) {
+    up = _mm256_srli_epi16(up, 1);
+    left = _mm256_srli_si256(left, 2);
+    vertical = _mm256_and_si256(vertical, up);
+    horizontal = _mm256_and_si256(horizontal, left);
+  }
+
+  __m256i runs = _mm256_or_si256(vertical, horizontal);
+
+  for (int i = 1; i < length; i++) {
+    vertical = _mm256_slli_epi16(vertical, 1);
+    horizontal = _mm256_slli_si256(horizontal, 2);
+    runs = _mm256_or_si256(runs, _mm256_or_si256(vertical, horizontal));
+  }
+
+  return runs;
+}
+
+
+/**
+ * @brief Same as `bb_fall()`, on two sets at once, one in each 128-bit lane.
+ */
+static inline __m256i bb_fall256(__m256i cells, __m256i falling) {
+  return _mm256_or_si256(_mm256_andnot_si256(falling, cells), _mm256_slli_epi16(_mm256_and_si256(cells, falling), 1));
+}
+
+
+/**
+ * @brief Same as `bb_runs()`, on two sets at once.
+ * @return bitboard The union of the runs found in the two sets.
+ */
+static inline bitboard bb_runs2(bitboard a, bitboard b, int length) {
+  __m256i runs = bb_runs256(_mm256_set_m128i(bb_load(b), bb_load(a)), length);
+
+  return bb_store(_mm_or_si128(_mm256_castsi256_si128(runs), _mm256_extracti128_si256(runs, 1)));
+}
+#endif
+
+#endif
@@ -0,0 +1,761 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+
+#include "bot.h"
+
+#define WIN_VALUE 1e9
+#define DANGER_ROWS 3
+#define BOT_ARENA_BLOCK_SIZE 65536
+
+const struct evaluation_weights default_weights = { -100.0, -2.0, -50.0, 1.0, -8.0, 20.0, 0.0 };
+
+
+/**
+ * A game reached by the search, saved as a snapshot with the next pill already in the grid. `root` is the placement of
+ * the current pill it comes from. When `keyed`, `key` is its key in the transposition table, the one of its mirror if
+ * `mirrored`: the games over are not looked up, they are carried to the next levels as they are.
+ */
+struct node {
+  struct snapshot snapshot;
+  double value;
+  int root;
+  bool keyed;
+  bool mirrored;
+  uint64_t key;
+};
+
+/**
+ * The levels of the beam of a thread: the best games of the last level, and the best ones reached from them so far,
+ * both at most as many as the width of the beam.
+ */
+struct beam {
+  struct node **nodes;
+  int count;
+  struct node **children;
+  int children_count;
+};
+
+/**
+ * The search of a thread, over the placements of the current pill from `first`, every `step`. It writes the value of
+ * its placements at every level in `values`, shared among the threads, which is `depth` rows of `placements->count`.
+ * Its nodes come from `pool`, in the arena of the thread, and `table_stats` counts its use of the transposition table.
+ */
+struct search {
+  const struct bot *bot;
+  const struct snapshot *root;
+  const struct placements *placements;
+  int first;
+  int step;
+  double deadline;
+  double *values;
+  struct arena *arena;
+  struct pool pool;
+  struct placements *children_placements;
+  struct table_stats table_stats;
+  int depth;
+  long long nodes;
+  bool failed;
+  bool threaded;
+  pthread_t thread;
+};
+
+
+/******************************************************************************/
+/* EVALUATION                                                                 */
+
+/**
+ * @brief Rates a game with the weights of `struct evaluation_weights`.
+ * @param game Pointer to the game instance.
+ * @param context The weights, or `NULL` for `default_weights`.
+ * @return double
+ */
+double evaluate_game(const struct game *game, const void *context) {
+  const struct evaluation_weights *weights = context ? context : &default_weights;
+  const struct board *board = &game->board;
+  bitboard occupied = bb_or(bb_or(board->color[RED], board->color[YELLOW]), board->color[BLUE]);
+  bitboard top = bb_zero();
+  int height = 0, adjacency = 0, buried = 0, stacked = 0;
+
+  for (int row = 0; row < DANGER_ROWS; row++)
+    top = bb_or(top, bb_row(row));
+
+  for (int column = 0; column < COLUMNS; column++)
+    height += ROWS - bb_next_row(occupied, -1, column);
+
+  for (int color = RED; color < BLANK; color++) {
+    bitboard cells = board->color[color];
+    bitboard others = bb_andnot(occupied, cells);
+    bitboard viruses = bb_and(board->virus, cells);
+    int row, column;
+
+    adjacency += bb_count(bb_and(cells, bb_up(cells))) + bb_count(bb_and(cells, bb_left(cells)));
+
+    // The rows above a virus are the lower bits of its column.
+    while (bb_pop(&viruses, &row, &column)) {
+      buried += bb_popcount(others.column[column] & ((1u << row) - 1));
+
+      for (int r = row - 1; r >= 0 && r > row - MIN_ELEMENTS && bb_test(cells, r, column); r--)
+        stacked++;
+    }
+  }
+
+  return weights->viruses * game->virus_count + weights->height * height +
+         weights->danger * bb_count(bb_and(occupied, top)) + weights->adjacency * adjacency +
+         weights->buried * buried + weights->stacked * stacked + weights->score * game->score;
+}
+
+
+/******************************************************************************/
+/* SEARCH                                                                     */
+
+/**
+ * @brief Returns the time elapsed from an arbitrary point, in seconds.
+ * @return double
+ */
+double get_bot_time() {
+  struct timespec now;
+
+  clock_gettime(CLOCK_MONOTONIC, &now);
+
+  return (double) now.tv_sec + (double) now.tv_nsec * 1e-9;
+}
+
+
+/**
+ * @brief Sets the default settings of the bot: two pills, the current one and the next one, a beam of 64 games, a
+ * single thread and no time budget.
+ * @param bot The bot.
+ */
+void init_bot(struct bot *bot) {
+  bot->depth = 2;
+  bot->width = 64;
+  bot->threads = 1;
+  bot->time_budget = 0;
+  bot->evaluate = evaluate_game;
+  bot->context = &default_weights;
+  bot->table = NULL;
+}
+
+
+/**
+ * @brief Lands the pill of a game on a placement, rates the game, then brings in the next pill.
+ * @details A game won is worth more the fewer pills it took, and a game lost, even when the next pill cannot appear,
+ * is worth the least.
+ * @param bot The bot.
+ * @param game Pointer to the game instance.
+ * @param placement The placement.
+ * @return double The value of the game.
+ */
+double play_placement(const struct bot *bot, struct game *game, const struct placement *placement) {
+  double value;
+
+  land_placement(game, placement);
+
+  if (game->status == VICTORY)
+    return WIN_VALUE - game->pills_count;
+
+  value = bot->evaluate(game, bot->context);
+
+  // A pill landing where it appears leaves the grid to the next one.
+  while (game->status == RUNNING && !game->pill.active)
+    execute(game, NONE);
+
+  return game->status == DEFEAT ? -WIN_VALUE : value;
+}
+
+
+/**
+ * @brief Moves a node of a heap down, towards its leaves, until its children are worth at least as much.
+ * @param heap The nodes of the heap, the worst one first.
+ * @param count The number of the nodes.
+ * @param index The index of the node.
+ */
+void sift_down(struct node **heap, int count, int index) {
+  struct node *node = heap[index];
+
+  for (int child = 2 * index + 1; child < count; child = 2 * index + 1) {
+    if (child + 1 < count && heap[child + 1]->value < heap[child]->value)
+      child++;
+
+    if (heap[child]->value >= node->value)
+      break;
+
+    heap[index] = heap[child];
+    index = child;
+  }
+
+  heap[index] = node;
+}
+
+
+/**
+ * @brief Tells whether a child would be kept in the next level of the beam.
+ * @param search The search.
+ * @param beam The beam.
+ * @param value The value of the child.
+ * @return bool
+ */
+bool is_kept(const struct search *search, const struct beam *beam, double value) {
+  return beam->children_count < search->bot->width || value > beam->children[0]->value;
+}
+
+
+/**
+ * @brief Makes room for a child in the next level of the beam, if it's worth keeping.
+ * @details The children are a heap with the worst one first: until the beam is full a node is taken from the pool,
+ * then the node of the worst child is given to the new one, if it's worth more. Only the children kept are saved.
+ * @param search The search.
+ * @param beam The beam.
+ * @param value The value of the child.
+ * @return struct node* The node of the child, to be filled in, or `NULL` if the child is not kept or there is no
+ * memory.
+ */
+struct node *add_child(struct search *search, struct beam *beam, double value) {
+  struct node **heap = beam->children;
+  struct node *node;
+  int index;
+
+  if (beam->children_count < search->bot->width) {
+    node = pool_alloc(&search->pool);
+
+    if (!node) {
+      search->failed = true;
+      return NULL;
+    }
+
+    // The node goes up from the last leaf, towards the root, while its parent is worth more.
+    for (index = beam->children_count++; index > 0 && heap[(index - 1) / 2]->value > value; index = (index - 1) / 2)
+      heap[index] = heap[(index - 1) / 2];
+
+    node->value = value;
+    heap[index] = node;
+
+    return node;
+  }
+
+  if (value <= heap[0]->value)
+    return NULL;
+
+  node = heap[0];
+  node->value = value;
+  sift_down(heap, beam->children_count, 0);
+
+  return node;
+}
+
+
+/**
+ * @brief Saves a game in a node of the search, with its key in the transposition table of the bot, if any.
+ * @details The key is the one of `get_canonical_hash()`, so that a game and its mirror share their entry where the
+ * symmetry holds.
+ * @param search The search.
+ * @param node The node.
+ * @param game Pointer to the game instance, with the next pill in the grid.
+ */
+void save_node(const struct search *search, struct node *node, const struct game *game) {
+  game_snapshot(game, &node->snapshot);
+  node->keyed = search->bot->table && game->status == RUNNING;
+  node->mirrored = false;
+  node->key = node->keyed ? get_canonical_hash(game, &node->mirrored) : 0;
+}
+
+
+/**
+ * @brief Returns the state of a placement as stored in the transposition table, the one of the reflected placement
+ * when the key of the game is the one of its mirror.
+ * @param game Pointer to the game instance.
+ * @param placement The placement.
+ * @param mirrored The key of the game is the one of its mirror.
+ * @return int
+ */
+int get_table_placement(const struct game *game, const struct placement *placement, bool mirrored) {
+  struct placement reflected = *placement;
+
+  if (mirrored)
+    mirror_placement(game, &reflected);
+
+  return reflected.state;
+}
+
+
+/**
+ * @brief Drops the games of a complete level which were already kept by the search, by any thread, at the same level
+ * or a shallower one, with a value at least as good, and remembers the others in the transposition table of the bot.
+ * @details A game only goes into the table once its level is complete, so that the game dropped is sure to be in the
+ * beam of a thread, which searches it. The best games come first, so of a game reached twice the best one is kept.
+ * @param search The search.
+ * @param beam The beam, with its level complete and sorted.
+ * @param level The pills landed from the current one to reach the games of the level, minus one.
+ */
+void drop_transpositions(struct search *search, struct beam *beam, int level) {
+  struct transposition_table *table = search->bot->table;
+  int depth = search->bot->depth - 1 - level;
+  int count = 0;
+
+  if (!table)
+    return;
+
+  for (int i = 0; i < beam->count; i++) {
+    struct node *node = beam->nodes[i];
+    struct transposition transposition;
+
+    if (node->keyed) {
+      if (probe_transposition(table, node->key, &transposition, &search->table_stats) && transposition.current &&
+          transposition.depth >= depth && transposition.value >= node->value) {
+        pool_free(&search->pool, node);
+        continue;
+      }
+
+      transposition.value = node->value;
+      transposition.depth = depth;
+      transposition.placement = -1;
+      store_transposition(table, node->key, &transposition, &search->table_stats);
+    }
+
+    beam->nodes[count++] = node;
+  }
+
+  beam->count = count;
+}
+
+
+/**
+ * @brief Remembers the best placement found for the pill of a game of the search, once its children are known.
+ * @param search The search.
+ * @param node The node of the game.
+ * @param game Pointer to the game instance, restored from the node.
+ * @param level The level of the children of the game.
+ * @param placement The placement leading to the best child.
+ */
+void store_best_placement(struct search *search, const struct node *node, const struct game *game, int level,
+                          const struct placement *placement) {
+  struct transposition transposition;
+
+  if (!search->bot->table || !node->keyed)
+    return;
+
+  transposition.value = node->value;
+  transposition.depth = search->bot->depth - level;
+  transposition.placement = get_table_placement(game, placement, node->mirrored);
+  store_transposition(search->bot->table, node->key, &transposition, &search->table_stats);
+}
+
+
+int compare_nodes(const void *a, const void *b) {
+  double x = (*(struct node *const *) a)->value, y = (*(struct node *const *) b)->value;
+
+  return (x < y) - (x > y);
+}
+
+
+/**
+ * @brief Turns the children of the beam into the games of its next level, best first, giving the old ones back to the
+ * pool, and drops the ones already kept by the search.
+ * @param search The search.
+ * @param beam The beam.
+ * @param level The level of the children.
+ */
+void next_level(struct search *search, struct beam *beam, int level) {
+  struct node **nodes = beam->nodes;
+
+  for (int i = 0; i < beam->count; i++)
+    pool_free(&search->pool, nodes[i]);
+
+  beam->nodes = beam->children;
+  beam->count = beam->children_count;
+  beam->children = nodes;
+  beam->children_count = 0;
+
+  qsort(beam->nodes, (size_t) beam->count, sizeof(struct node *), compare_nodes);
+  drop_transpositions(search, beam, level);
+}
+
+
+/**
+ * @brief Expands the games of a level of the beam, landing their pill everywhere it can land, and keeps the best ones
+ * for the next level.
+ * @details A game over has no children, it is carried to the next level as it is.
+ * @param search The search.
+ * @param beam The beam.
+ * @param level The level of the children, for the values of the placements of the current pill.
+ * @return bool Returns `false` if the time budget ran out, leaving the level unfinished, or there is no memory.
+ */
+bool expand_level(struct search *search, struct beam *beam, int level) {
+  const struct bot *bot = search->bot;
+  struct placements *placements = search->children_placements;
+  struct game game;
+  double *values = &search->values[level * search->placements->count];
+
+  init_game(&game, 0);
+
+  for (int i = 0; i < beam->count; i++) {
+    const struct node *node = beam->nodes[i];
+
+    if (search->deadline > 0 && get_bot_time() > search->deadline)
+      return false;
+
+    game_restore(&game, &node->snapshot);
+
+    int count = game.status == RUNNING ? find_placements(&game, placements) : 0;
+    search->nodes++;
+
+    if (count == 0) {
+      struct node *child = add_child(search, beam, node->value);
+
+      if (node->value > values[node->root])
+        values[node->root] = node->value;
+
+      if (child) {
+        child->root = node->root;
+        child->snapshot = node->snapshot;
+        child->keyed = node->keyed;
+        child->key = node->key;
+      }
+    }
+
+    int best = -1;
+    double best_value = 0;
+
+    for (int j = 0; j < count; j++) {
+      if (j > 0)
+        game_restore(&game, &node->snapshot);
+
+      double value = play_placement(bot, &game, &placements->placement[j]);
+
+      // A placement of the current pill is worth the best game it leads to, kept or not.
+      if (value > values[node->root])
+        values[node->root] = value;
+
+      if (best < 0 || value > best_value) {
+        best = j;
+        best_value = value;
+      }
+
+      if (!is_kept(search, beam, value))
+        continue;
+
+      struct node *child = add_child(search, beam, value);
+
+      if (child) {
+        child->root = node->root;
+        save_node(search, child, &game);
+      }
+    }
+
+    // The placement is reflected with the pill of the game, which the last placement played has replaced.
+    if (best >= 0) {
+      if (node->mirrored)
+        game_restore(&game, &node->snapshot);
+
+      store_best_placement(search, node, &game, level, &placements->placement[best]);
+    }
+
+    if (search->failed)
+      return false;
+  }
+
+  next_level(search, beam, level);
+
+  return true;
+}
+
+
+/**
+ * @brief Body of the threads of the search: a beam search from the placements of the current pill given to the thread.
+ * @details Everything the search needs comes from the arena of the thread, the nodes through a pool: once the arena is
+ * large enough, searching does not touch the heap.
+ * @param argument The search.
+ */
+void *run_search(void *argument) {
+  struct search *search = argument;
+  const struct placements *placements = search->placements;
+  struct beam beam = { 0 };
+  struct game game;
+
+  init_pool(&search->pool, search->arena, sizeof(struct node));
+  beam.nodes = arena_alloc(search->arena, sizeof(struct node *) * (size_t) search->bot->width);
+  beam.children = arena_alloc(search->arena, sizeof(struct node *) * (size_t) search->bot->width);
+  search->children_placements = arena_alloc(search->arena, sizeof(struct placements));
+
+  if (!beam.nodes || !beam.children || !search->children_placements) {
+    search->failed = true;
+    return NULL;
+  }
+
+  init_game(&game, 0);
+
+  // The first level is never cut short: it's needed to choose.
+  for (int i = search->first; i < placements->count; i += search->step) {
+    game_restore(&game, search->root);
+
+    double value = play_placement(search->bot, &game, &placements->placement[i]);
+
+    search->values[i] = value;
+    search->nodes++;
+
+    if (!is_kept(search, &beam, value))
+      continue;
+
+    struct node *node = add_child(search, &beam, value);
+
+    if (node) {
+      node->root = i;
+      save_node(search, node, &game);
+    } else if (search->failed) {
+      return NULL;
+    }
+  }
+
+  next_level(search, &beam, 0);
+  search->depth = 1;
+
+  while (search->depth < search->bot->depth && expand_level(search, &beam, search->depth))
+    search->depth++;
+
+  return NULL;
+}
+
+
+/**
+ * @brief Initializes the memory of the searches of a bot, which is allocated as needed and kept from a choice to the
+ * next one.
+ * @param workspace The workspace.
+ */
+void init_bot_workspace(struct bot_workspace *workspace) {
+  for (int t = 0; t < MAX_BOT_THREADS; t++)
+    init_arena(&workspace->arenas[t], BOT_ARENA_BLOCK_SIZE);
+}
+
+
+/**
+ * @brief Gives back the memory of the searches of a bot.
+ * @param workspace The workspace.
+ */
+void free_bot_workspace(struct bot_workspace *workspace) {
+  for (int t = 0; t < MAX_BOT_THREADS; t++)
+    free_arena(&workspace->arenas[t]);
+}
+
+
+/**
+ * @brief Chooses where to land the active pill.
+ * @details Every thread searches the placements of the current pill it is given, keeping its own beam in its own
+ * arena of the workspace, which is reset first. The placements are compared at the deepest level all the threads
+ * completed. With a transposition table, the placement chosen is stored with the game, and if no level could be
+ * completed, the one stored by an earlier search is taken.
+ * @param bot The bot.
+ * @param workspace The memory of the search, or `NULL` to use memory allocated for this choice only.
+ * @param game Pointer to the game instance, with an active pill.
+ * @param placements Receives the placements of the active pill, as found by `find_placements()`.
+ * @param stats Receives what the search did, unless `NULL`, all zero if it did not search.
+ * @return int The index of the placement chosen, or `-1` if the pill cannot land anywhere or there is no memory.
+ */
+int bot_choose(const struct bot *bot, struct bot_workspace *workspace, const struct game *game,
+               struct placements *placements, struct bot_stats *stats) {
+  struct search searches[MAX_BOT_THREADS];
+  struct bot_workspace *temporary = NULL;
+  struct snapshot root;
+  double start = get_bot_time();
+  int count = find_placements(game, placements);
+  int threads = bot->threads < count ? bot->threads : count;
+  int depth = bot->depth > 1 ? bot->depth : 1;
+  int best = -1;
+  long long allocations = 0, heap_allocations = 0;
+
+  if (threads > MAX_BOT_THREADS)
+    threads = MAX_BOT_THREADS;
+  if (threads < 1)
+    threads = 1;
+
+  // The stats of a choice which searched nothing are zero, not the ones of the last choice.
+  if (stats)
+    memset(stats, 0, sizeof(struct bot_stats));
+
+  if (count == 0 || bot->width < 1)
+    return -1;
+
+  if (!workspace) {
+    workspace = temporary = malloc(sizeof(struct bot_workspace));
+
+    if (!workspace)
+      return -1;
+
+    init_bot_workspace(workspace);
+  }
+
+  for (int t = 0; t < threads; t++) {
+    struct arena *arena = &workspace->arenas[t];
+
+    arena_reset(arena);
+    allocations -= arena->allocations;
+    heap_allocations -= arena->heap_allocations;
+  }
+
+  double *values = arena_alloc(&workspace->arenas[0], sizeof(double) * (size_t) (depth * count));
+
+  if (!values) {
+    if (temporary) {
+      free_bot_workspace(temporary);
+      free(temporary);
+    }
+
+    return -1;
+  }
+
+  for (int i = 0; i < depth * count; i++)
+    values[i] = -2 * WIN_VALUE;
+
+  game_snapshot(game, &root);
+
+  // The game was likely reached by the search of the last pill, which kept its best placement.
+  struct transposition transposition = { 0, 0, -1, false };
+  bool mirrored = false;
+  uint64_t key = bot->table ? get_canonical_hash(game, &mirrored) : 0;
+
+  if (bot->table) {
+    age_transposition_table(bot->table);
+
+    if (!probe_transposition(bot->table, key, &transposition, NULL))
+      transposition.placement = -1;
+  }
+
+  for (int t = 0; t < threads; t++) {
+    struct search *search = &searches[t];
+
+    memset(search, 0, sizeof(struct search));
+    search->bot = bot;
+    search->root = &root;
+    search->placements = placements;
+    search->first = t;
+    search->step = threads;
+    search->deadline = bot->time_budget > 0 ? start + bot->time_budget : 0;
+    search->values = values;
+    search->arena = &workspace->arenas[t];
+
+    // The first search runs on the calling thread, and so do the others when a thread cannot be started.
+    if (t > 0)
+      search->threaded = pthread_create(&search->thread, NULL, run_search, search) == 0;
+  }
+
+  for (int t = 0; t < threads; t++) {
+    if (!searches[t].threaded)
+      run_search(&searches[t]);
+  }
+
+  for (int t = 1; t < threads; t++) {
+    if (searches[t].threaded)
+      pthread_join(searches[t].thread, NULL);
+  }
+
+  int level = depth;
+  long long nodes = 0;
+  size_t memory = 0;
+  struct table_stats table_stats = { 0 };
+
+  for (int t = 0; t < threads; t++) {
+    const struct arena *arena = &workspace->arenas[t];
+
+    if (searches[t].depth < level)
+      level = searches[t].depth;
+
+    nodes += searches[t].nodes;
+    allocations += arena->allocations + searches[t].pool.reuses;
+    heap_allocations += arena->heap_allocations;
+    memory += arena->used;
+    add_table_stats(&table_stats, &searches[t].table_stats);
+  }
+
+  if (level > 0) {
+    const double *level_values = &values[(level - 1) * count];
+
+    best = 0;
+
+    for (int i = 1; i < count; i++) {
+      if (level_values[i] > level_values[best])
+        best = i;
+    }
+
+    if (bot->table) {
+      transposition.value = level_values[best];
+      transposition.depth = level;
+      transposition.placement = get_table_placement(game, &placements->placement[best], mirrored);
+      store_transposition(bot->table, key, &transposition, NULL);
+    }
+  } else {
+    // Without a level complete, the placement found by an earlier search is better than none.
+    for (int i = 0; i < count; i++) {
+      if (get_table_placement(game, &placements->placement[i], mirrored) == transposition.placement)
+        best = i;
+    }
+  }
+
+  if (stats) {
+    stats->nodes = nodes;
+    stats->depth = level;
+    stats->seconds = get_bot_time() - start;
+    stats->allocations = allocations;
+    stats->heap_allocations = heap_allocations;
+    stats->memory = memory;
+    stats->table = table_stats;
+  }
+
+  if (temporary) {
+    free_bot_workspace(temporary);
+    free(temporary);
+  }
+
+  return best;
+}
+
+
+/******************************************************************************/
+/* PLAYER                                                                     */
+
+/**
+ * @brief Initializes a player driven by a bot.
+ * @param player The player.
+ * @param bot The bot, which must outlive the player.
+ */
+void init_bot_player(struct bot_player *player, const struct bot *bot) {
+  memset(player, 0, sizeof(struct bot_player));
+  player->bot = bot;
+  init_bot_workspace(&player->workspace);
+}
+
+
+/**
+ * @brief Gives back the memory of a player driven by a bot.
+ * @param player The player.
+ */
+void free_bot_player(struct bot_player *player) {
+  free_bot_workspace(&player->workspace);
+}
+
+
+/**
+ * @brief Returns the command of the player for the next tick.
+ * @details Without an active pill the command is `NONE`, which brings in the next one. The last command of a plan
+ * lands the pill; if the pill is still there once the plan is over, it is dropped.
+ * @param player The player.
+ * @param game Pointer to the game instance.
+ * @return command
+ */
+enum command bot_next_command(struct bot_player *player, const struct game *game) {
+  if (!game->pill.active)
+    return NONE;
+
+  if (game->pills_count != player->pills_count) {
+    int index = bot_choose(player->bot, &player->workspace, game, &player->placements, &player->stats);
+
+    add_table_stats(&player->table_stats, &player->stats.table);
+    player->pills_count = game->pills_count;
+    player->length = index >= 0 ? get_placement_commands(&player->placements, index, player->plan) : 0;
+    player->position = 0;
+  }
+
+  return player->position < player->length ? player->plan[player->position++] : DOWN;
+}
@@ -0,0 +1,112 @@
+#ifndef BOT_H
+#define BOT_H
+
+#include "drmauro.h"
+#include "placement.h"
+#include "arena.h"
+#include "transposition.h"
+
+#define MAX_BOT_THREADS 64
+
+
+/**
+ * Rates a game where a pill has just landed, the higher the better. `context` is the one of the bot, the weights of
+ * the features for `evaluate_game()`. The games won or lost are rated by the search itself.
+ */
+typedef double (*bot_evaluation)(const struct game *game, const void *context);
+
+/**
+ * The weights of the features rated by `evaluate_game()`, every one multiplied by its count:
+ *   - `viruses`: the viruses left;
+ *   - `height`: the cells from the bottom of every column to its topmost taken cell;
+ *   - `danger`: the cells taken in the top rows, where the pills appear;
+ *   - `adjacency`: the couples of neighbours of the same color, which are on their way to a match;
+ *   - `buried`: the cells above a virus, in its column, having another color, which have to go before it;
+ *   - `stacked`: the cells of the same color piled right above a virus, up to the ones which clear it;
+ *   - `score`: the points scored.
+ */
+struct evaluation_weights {
+  double viruses;
+  double height;
+  double danger;
+  double adjacency;
+  double buried;
+  double stacked;
+  double score;
+};
+
+/**
+ * The settings of the bot. It runs a beam search over the placements of the next `depth` pills, keeping the best
+ * `width` games of every level, and picks the placement of the current pill leading to the best one. The placements of
+ * the current pill are shared among `threads` threads, each one searching its own beam. When `time_budget` is not
+ * zero, the search stops at the last level completed within that many seconds.
+ * With a transposition `table`, the games of a level are stored once the level is complete, and a game already kept
+ * by any thread, at the same level or a shallower one, with a value at least as good, is dropped: the thread which
+ * kept it searches it. The table also keeps the best placement found for the pill of every game expanded. The games
+ * are keyed by `get_canonical_hash()`, so a game and its mirror share their entry where the symmetry holds, and the
+ * placement stored is reflected for the one whose key is the one of the mirror.
+ * Like `game_hash()`, the search knows the colors of the pills to come, since the generator is part of the game.
+ */
+struct bot {
+  int depth;
+  int width;
+  int threads;
+  double time_budget;
+  bot_evaluation evaluate;
+  const void *context;
+  struct transposition_table *table;
+};
+
+/**
+ * What a search did: the games expanded and the levels completed by every thread, the allocations served by the
+ * arenas of the workspace and how many of them went to the heap, the bytes used, and what the transposition table did,
+ * where a hit is a game found in the table, from this search or an earlier one.
+ */
+struct bot_stats {
+  long long nodes;
+  int depth;
+  double seconds;
+  long long allocations;
+  long long heap_allocations;
+  size_t memory;
+  struct table_stats table;
+};
+
+/**
+ * The memory of the searches of a bot, an arena per thread, reset at every choice. The arenas keep their memory from a
+ * choice to the next one, so that after the first few choices a search does not allocate from the heap any more.
+ */
+struct bot_workspace {
+  struct arena arenas[MAX_BOT_THREADS];
+};
+
+/**
+ * A player driven by the bot, giving a command per tick: when a pill appears, the bot chooses where to land it and the
+ * commands to get there are planned. `stats` are the ones of the last choice, `table_stats` add up all of them.
+ */
+struct bot_player {
+  const struct bot *bot;
+  struct placements placements;
+  enum command plan[PILL_STATES];
+  int length;
+  int position;
+  int pills_count;
+  struct bot_stats stats;
+  struct table_stats table_stats;
+  struct bot_workspace workspace;
+};
+
+extern const struct evaluation_weights default_weights;
+
+
+void init_bot(struct bot *bot);
+double evaluate_game(const struct game *game, const void *context);
+void init_bot_workspace(struct bot_workspace *workspace);
+void free_bot_workspace(struct bot_workspace *workspace);
+int bot_choose(const struct bot *bot, struct bot_workspace *workspace, const struct game *game,
+               struct placements *placements, struct bot_stats *stats);
+void init_bot_player(struct bot_player *player, const struct bot *bot);
+void free_bot_player(struct bot_player *player);
+enum command bot_next_command(struct bot_player *player, const struct game *game);
+
+#endif
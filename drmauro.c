@@ -1,22 +1,423 @@
 #include <stdio.h>
 #include <stdlib.h>
-#include <time.h>
 #include <math.h>
 #include <assert.h>
 #include <string.h>
 #include <stdbool.h>
 #include <ctype.h>
+#include <stdarg.h>
 
 #include "drmauro.h"
 
+// Messages are only formatted when the game is logging them. Building with `DRMAURO_NO_TRACE` removes them altogether.
+#ifdef DRMAURO_NO_TRACE
+#define TRACE(game, level, ...) ((void) 0)
+#define TRACE_GRID(game, level, title) ((void) 0)
+#else
+#define TRACE(game, level, ...) do { if (is_logging(game, level)) log_message(game, level, __VA_ARGS__); } while (0)
+#define TRACE_GRID(game, level, title) do { if (is_logging(game, level)) log_grid(game, level, title); } while (0)
+#endif
+
+#define LOG_MESSAGE_SIZE 512
+#define BATCH_SIZE 64
+
+// The Zobrist keys of the cells are drawn for every set of the board, the colors first, then the viruses and the two
+// sets of links. The keys of the pills are apart.
+#define VIRUS_KEYS BLANK
+#define LINK_KEYS (BLANK + 1)
+#define PILL_KEYS (1 << 16)
+#define NEXT_PILL_KEYS (2 << 16)
+#define CELL_KEYS ((BLANK + 3) * ROWS * COLUMNS)
+
+// The same splitmix64 step of `get_zobrist_key()`, written as a constant expression so that the keys of the cells are
+// computed by the compiler.
+#define ZOBRIST_SEED(i) (((uint64_t) (i) << 32 ^ UINT64_C(0x6a09e667f3bcc908)) + UINT64_C(0x9e3779b97f4a7c15))
+#define ZOBRIST_MIX1(z) (((z) ^ ((z) >> 30)) * UINT64_C(0xbf58476d1ce4e5b9))
+#define ZOBRIST_MIX2(z) (((z) ^ ((z) >> 27)) * UINT64_C(0x94d049bb133111eb))
+#define ZOBRIST_KEY(i) (ZOBRIST_MIX2(ZOBRIST_MIX1(ZOBRIST_SEED(i))) ^ ZOBRIST_MIX2(ZOBRIST_MIX1(ZOBRIST_SEED(i))) >> 31)
+#define ZOBRIST_KEYS4(i) ZOBRIST_KEY(i), ZOBRIST_KEY((i) + 1), ZOBRIST_KEY((i) + 2), ZOBRIST_KEY((i) + 3)
+#define ZOBRIST_KEYS16(i) ZOBRIST_KEYS4(i), ZOBRIST_KEYS4((i) + 4), ZOBRIST_KEYS4((i) + 8), ZOBRIST_KEYS4((i) + 12)
+#define ZOBRIST_KEYS64(i) ZOBRIST_KEYS16(i), ZOBRIST_KEYS16((i) + 16), ZOBRIST_KEYS16((i) + 32), ZOBRIST_KEYS16((i) + 48)
+#define ZOBRIST_KEYS256(i) ZOBRIST_KEYS64(i), ZOBRIST_KEYS64((i) + 64), ZOBRIST_KEYS64((i) + 128), ZOBRIST_KEYS64((i) + 192)
+
+_Static_assert(ROWS == BITBOARD_ROWS && COLUMNS == BITBOARD_COLUMNS, "the grid must fit in a bitboard");
+_Static_assert(CELL_KEYS == 3 * 256, "the keys of the cells are written as three blocks of 256");
+
+static const uint64_t cell_keys[CELL_KEYS] = { ZOBRIST_KEYS256(0), ZOBRIST_KEYS256(256), ZOBRIST_KEYS256(512) };
+
+
+/**
+ * @brief Returns `true` if the coordinates (row, column) are inside the grid perimeter.
+ * @param row Position on the y-axis.
+ * @param column Position on the x-axis.
+ * @return bool
+ */
+bool is_inside_grid(int row, int column) {
+  return row >= 0 && row < ROWS && column >= 0 && column < COLUMNS;
+}
+
+
+/**
+ * @brief Returns the occupied cells of the board, namely the union of the color masks.
+ * @param board Pointer to the board.
+ * @return bitboard
+ */
+bitboard get_occupied_cells(const struct board *board) {
+  return bb_or(bb_or(board->color[RED], board->color[YELLOW]), board->color[BLUE]);
+}
+
+
+/**
+ * @brief Returns the Zobrist key of an index, spread by a splitmix64 step. The keys of the cells are the same, stored
+ * in `cell_keys`; the ones of the pills are too many for a table and are computed when needed.
+ * @param index The index: the set and the cell, or the pill.
+ * @return uint64_t
+ */
+uint64_t get_zobrist_key(uint64_t index) {
+  uint64_t x = index << 32 ^ UINT64_C(0x6a09e667f3bcc908);
+
+  return rng_splitmix64(&x);
+}
+
+
+/**
+ * @brief Returns the Zobrist key of a cell of a set of the board.
+ * @param set The set: a color, `VIRUS_KEYS`, or `LINK_KEYS` plus the direction of the link.
+ * @param row Position on the y-axis.
+ * @param column Position on the x-axis.
+ * @return uint64_t
+ */
+uint64_t get_cell_key(int set, int row, int column) {
+  return cell_keys[(set * COLUMNS + column) * ROWS + row];
+}
+
+
+/**
+ * @brief Returns the hash of the cells of a set of the board.
+ * @details On a little-endian machine, the bit of a cell in the words of the bitboard is also its index among the keys
+ * of the set.
+ * @param set The set.
+ * @param cells The cells.
+ * @return uint64_t
+ */
+uint64_t hash_cells(int set, bitboard cells) {
+  const uint64_t *keys = &cell_keys[set * ROWS * COLUMNS];
+  uint64_t hash = 0;
+
+  for (int w = 0; w < 2; w++) {
+    for (uint64_t bits = cells.word[w]; bits; bits &= bits - 1)
+      hash ^= keys[64 * w + bb_ctz64(bits)];
+  }
+
+  return hash;
+}
+
+
+/**
+ * @brief Returns how the hash changes when a board changes, looking only at the cells which differ.
+ * @param before The board before the change.
+ * @param after The board after the change.
+ * @return uint64_t The value to XOR to the hash.
+ */
+uint64_t hash_board_change(const struct board *before, const struct board *after) {
+  uint64_t hash = 0;
+
+  for (int color = RED; color < BLANK; color++)
+    hash ^= hash_cells(color, bb_xor(before->color[color], after->color[color]));
+
+  hash ^= hash_cells(VIRUS_KEYS, bb_xor(before->virus, after->virus));
+  hash ^= hash_cells(LINK_KEYS + HORIZONTAL, bb_xor(before->link[HORIZONTAL], after->link[HORIZONTAL]));
+  hash ^= hash_cells(LINK_KEYS + VERTICAL, bb_xor(before->link[VERTICAL], after->link[VERTICAL]));
+
+  return hash;
+}
+
+
+/**
+ * @brief Returns the hash of the active pill, 0 when there is none.
+ * @details The second half is always next to the first one, on its right or above it, so the position of the first
+ * half and the orientation are enough. The colors are hashed here too, since a half may be out of the grid.
+ * @param pill The pill.
+ * @return uint64_t
+ */
+uint64_t hash_pill(const struct pill *pill) {
+  if (!pill->active)
+    return 0;
+
+  return get_zobrist_key(PILL_KEYS | (uint64_t) pill->orientation << 12 | (uint64_t) pill->first_half.color << 10 |
+                         (uint64_t) pill->second_half.color << 8 |
+                         (uint64_t) (pill->first_half.row + PILL_ROW_OFFSET) << 3 |
+                         (uint64_t) pill->first_half.column);
+}
+
+
+/**
+ * @brief Sets a cell of a set of the board, keeping the hash of the game up to date.
+ * @param game Pointer to the game instance.
+ * @param cells The set.
+ * @param set The index of the set, for its Zobrist keys.
+ * @param row Position on the y-axis.
+ * @param column Position on the x-axis.
+ */
+void set_board_cell(struct game *game, bitboard *cells, int set, int row, int column) {
+  if (bb_test(*cells, row, column))
+    return;
+
+  bb_set(cells, row, column);
+  game->hash ^= get_cell_key(set, row, column);
+}
+
+
+/**
+ * @brief Resets a cell of a set of the board, keeping the hash of the game up to date.
+ * @param game Pointer to the game instance.
+ * @param cells The set.
+ * @param set The index of the set, for its Zobrist keys.
+ * @param row Position on the y-axis.
+ * @param column Position on the x-axis.
+ */
+void reset_board_cell(struct game *game, bitboard *cells, int set, int row, int column) {
+  if (!bb_test(*cells, row, column))
+    return;
+
+  bb_reset(cells, row, column);
+  game->hash ^= get_cell_key(set, row, column);
+}
+
+
+/**
+ * @brief Computes the hash of the board and of the active pill from scratch. The game keeps it up to date as it
+ * changes, this is how it's checked.
+ * @param game Pointer to the game instance.
+ * @return uint64_t
+ */
+uint64_t compute_hash(const struct game *game) {
+  static const struct board empty;
+
+  return hash_board_change(&empty, &game->board) ^ hash_pill(&game->pill);
+}
+
+
+/**
+ * @brief Returns the Zobrist key of the next pill. The pill is not drawn yet, so its colors are peeked from a copy of
+ * the generator.
+ * @param game Pointer to the game instance.
+ * @param colors_swapped Returns the key of the next pill with its colors swapped, as it spawns in the mirrored game.
+ * @return uint64_t
+ */
+uint64_t get_next_pill_hash(const struct game *game, bool colors_swapped) {
+  struct rng rng = game->rng;
+  uint64_t first_color = rng_below(&rng, BLANK);
+  uint64_t second_color = rng_below(&rng, BLANK);
+
+  if (colors_swapped)
+    return get_zobrist_key(NEXT_PILL_KEYS | second_color << 2 | first_color);
+
+  return get_zobrist_key(NEXT_PILL_KEYS | first_color << 2 | second_color);
+}
+
+
+/**
+ * @brief Returns the Zobrist hash of the grid, of the active pill and of the next pill, for transposition tables and to
+ * detect duplicate positions.
+ * @details The hash of the grid and of the active pill is updated at every change, the one of the next pill is given by
+ * `get_next_pill_hash()`.
+ * @param game Pointer to the game instance.
+ * @return uint64_t
+ */
+uint64_t game_hash(const struct game *game) {
+  return game->hash ^ get_next_pill_hash(game, false);
+}
+
+
+/**
+ * @brief Returns where the other half of the pill is, for a half at the coordinates (row, column).
+ * @details Every half carries a single bit of link, on the mask of its orientation, which tells whether it is joined
+ * to the next cell on the right or below. Links towards the left or above are the ones of the neighbour cells.
+ * @param game Pointer to the game instance.
+ * @param row Position on the y-axis.
+ * @param column Position on the x-axis.
+ * @return enum link
+ */
+enum link get_link(const struct game *game, int row, int column) {
+  const struct board *board = &game->board;
+
+  if (bb_test(board->link[HORIZONTAL], row, column))
+    return LINKED_RIGHT;
+
+  if (bb_test(board->link[VERTICAL], row, column))
+    return LINKED_DOWN;
+
+  if (column > 0 && bb_test(board->link[HORIZONTAL], row, column - 1))
+    return LINKED_LEFT;
+
+  if (row > 0 && bb_test(board->link[VERTICAL], row - 1, column))
+    return LINKED_UP;
+
+  return UNLINKED;
+}
+
+
+/**
+ * @brief Returns the content of the cell at the coordinates (row, column). Cells outside the grid are empty.
+ * @param game Pointer to the game instance.
+ * @param row Position on the y-axis.
+ * @param column Position on the x-axis.
+ * @return struct cell
+ */
+struct cell get_cell(const struct game *game, int row, int column) {
+  struct cell cell = { EMPTY, BLANK, UNLINKED };
+
+  if (!is_inside_grid(row, column))
+    return cell;
+
+  for (int color = RED; color < BLANK; color++) {
+    if (bb_test(game->board.color[color], row, column)) {
+      cell.type = bb_test(game->board.virus, row, column) ? VIRUS : PILL;
+      cell.color = (enum color) color;
+      cell.link = get_link(game, row, column);
+      break;
+    }
+  }
+
+  return cell;
+}
+
+
+/**
+ * @brief Returns `true` if the cell at the coordinates (row, column) is empty.
+ * @param game Pointer to the game instance.
+ * @param row Position on the y-axis.
+ * @param column Position on the x-axis.
+ * @return bool
+ */
+bool is_empty_cell(const struct game *game, int row, int column) {
+  if (!is_inside_grid(row, column))
+    return true;
+
+  return !bb_test(get_occupied_cells(&game->board), row, column);
+}
+
+
+/**
+ * @brief Returns the row where a half falling from the coordinates (row, column) stops, namely the last empty cell
+ * above the first occupied one, or the bottom of the grid.
+ * @details The column mask of the occupied cells gives the landing row with a single bit scan, so the column is never
+ * walked cell by cell.
+ * @param game Pointer to the game instance.
+ * @param row Position on the y-axis, `-1` for a half entering the grid.
+ * @param column Position on the x-axis.
+ * @return int
+ */
+int get_landing_row(const struct game *game, int row, int column) {
+  return bb_next_row(get_occupied_cells(&game->board), row, column) - 1;
+}
+
+
+/**
+ * @brief Returns the height of the stack of viruses and pills of a column, measured from the bottom of the grid up to
+ * its topmost occupied cell.
+ * @param game Pointer to the game instance.
+ * @param column Position on the x-axis.
+ * @return int
+ */
+int get_column_height(const struct game *game, int column) {
+  return ROWS - bb_next_row(get_occupied_cells(&game->board), -1, column);
+}
+
+
+/**
+ * @brief Empties the cell at the coordinates (row, column). If the cell holds a pill's half, the pill is broken.
+ * @param game Pointer to the game instance.
+ * @param row Position on the y-axis.
+ * @param column Position on the x-axis.
+ */
+void clear_cell(struct game *game, int row, int column) {
+  struct board *board = &game->board;
+
+  if (!is_inside_grid(row, column))
+    return;
+
+  for (int color = RED; color < BLANK; color++)
+    reset_board_cell(game, &board->color[color], color, row, column);
+
+  reset_board_cell(game, &board->virus, VIRUS_KEYS, row, column);
+  reset_board_cell(game, &board->link[HORIZONTAL], LINK_KEYS + HORIZONTAL, row, column);
+  reset_board_cell(game, &board->link[VERTICAL], LINK_KEYS + VERTICAL, row, column);
+
+  if (column > 0)
+    reset_board_cell(game, &board->link[HORIZONTAL], LINK_KEYS + HORIZONTAL, row, column - 1);
+
+  if (row > 0)
+    reset_board_cell(game, &board->link[VERTICAL], LINK_KEYS + VERTICAL, row - 1, column);
+}
+
+
+/**
+ * @brief Puts a virus or a pill's half in the cell at the coordinates (row, column). Cells outside the grid are ignored.
+ * @param game Pointer to the game instance.
+ * @param row Position on the y-axis.
+ * @param column Position on the x-axis.
+ * @param type The content of the cell.
+ * @param color The color of the virus or of the half.
+ */
+void set_cell(struct game *game, int row, int column, enum content type, enum color color) {
+  clear_cell(game, row, column);
+
+  if (!is_inside_grid(row, column) || type == EMPTY || color == BLANK)
+    return;
+
+  set_board_cell(game, &game->board.color[color], color, row, column);
+
+  if (type == VIRUS)
+    set_board_cell(game, &game->board.virus, VIRUS_KEYS, row, column);
+}
+
+
+/**
+ * @brief Records that the content of the cell at the coordinates (row, column) changed, so the lines crossing it have
+ * to be checked for groups of cells of the same color. Cells outside the grid are ignored.
+ * @param game Pointer to the game instance.
+ * @param row Position on the y-axis.
+ * @param column Position on the x-axis.
+ */
+void mark_cell_changed(struct game *game, int row, int column) {
+  if (is_inside_grid(row, column))
+    bb_set(&game->changed_cells, row, column);
+}
+
+
+/**
+ * @brief Joins two adjacent halves, so they fall together as a single pill.
+ * @details Nothing happens when one of the halves is outside the grid.
+ * @param game Pointer to the game instance.
+ * @param first_half First half of the pill.
+ * @param second_half Second half of the pill.
+ */
+void link_halves(struct game *game, const struct halve *first_half, const struct halve *second_half) {
+  if (!is_inside_grid(first_half->row, first_half->column) || !is_inside_grid(second_half->row, second_half->column))
+    return;
+
+  // The link is always stored in the leftmost or topmost half.
+  if (first_half->row == second_half->row) {
+    int column = first_half->column < second_half->column ? first_half->column : second_half->column;
+    set_board_cell(game, &game->board.link[HORIZONTAL], LINK_KEYS + HORIZONTAL, first_half->row, column);
+  }
+  else {
+    int row = first_half->row < second_half->row ? first_half->row : second_half->row;
+    set_board_cell(game, &game->board.link[VERTICAL], LINK_KEYS + VERTICAL, row, first_half->column);
+  }
+}
+
 
 /**
  * @brief Returns a random color between the ones available.
  * @details Such colors are used for virus and pills independently.
+ * @param game Pointer to the game instance.
  * @return int
  */
-int get_random_color() {
-  return rand() % BLANK;
+int get_random_color(struct game *game) {
+  return (int) rng_below(&game->rng, BLANK);
 }
 
 
@@ -27,14 +428,14 @@ int get_random_color() {
  * @param y Position on the y-axis.
  */
 void change_virus_color(struct game *game, int x, int y) {
-  int current_color = game->grid[x][y].color;
+  int current_color = get_cell(game, x, y).color;
   int new_color;
 
   do {
-    new_color = get_random_color();
+    new_color = get_random_color(game);
   } while (new_color == current_color);
 
-  game->grid[x][y].color = (enum color) new_color;
+  set_cell(game, x, y, VIRUS, (enum color) new_color);
 }
 
 
@@ -52,20 +453,27 @@ void reorganize_viruses(struct game *game) {
   for (x = first_row; x < ROWS; x++) {
     for (y = first_column; y < COLUMNS; y++) {
 
+      struct cell cell = get_cell(game, x, y);
+
       // If the cell is empty, then continue.
-      if (game->grid[x][y].type == EMPTY)
+      if (cell.type == EMPTY)
         continue;
       else
         game->virus_count++;
 
       // This is the color of the virus at the coordinates `x`, `y`.
-      int color = game->grid[x][y].color;
+      enum color color = cell.color;
+
+      // Cells outside the grid are empty, so the viruses on the first two columns or rows are compared only with the
+      // ones which actually precede them.
+      struct cell left = get_cell(game, x, y-1), second_left = get_cell(game, x, y-2);
+      struct cell top = get_cell(game, x-1, y), second_top = get_cell(game, x-2, y);
 
       // True when there are two consecutive viruses of the same color on the same row or column.
-      bool invalid = (game->grid[x][y-1].type == VIRUS && color == game->grid[x][y-1].color &&
-                      game->grid[x][y-2].type == VIRUS && color == game->grid[x][y-2].color) ||
-                     (game->grid[x-1][y].type == VIRUS && game->grid[x-1][y].color &&
-                      game->grid[x-2][y].type == VIRUS && color == game->grid[x - 2][y].color);
+      bool invalid = (left.type == VIRUS && color == left.color &&
+                      second_left.type == VIRUS && color == second_left.color) ||
+                     (top.type == VIRUS && color == top.color &&
+                      second_top.type == VIRUS && color == second_top.color);
 
       // If the current virus is of the same color of the two previous cells of the same row or column, then change
       // the color of the current cell.
@@ -80,6 +488,7 @@ void reorganize_viruses(struct game *game) {
 /**
  * @brief Returns the correspondent letter to a color.
  * @param color A color of a virus or a pill.
+ * @return char The letter, or `?` if the color is not supported.
  */
 char get_letter_color(enum color color) {
   switch (color) {
@@ -90,54 +499,184 @@ char get_letter_color(enum color color) {
     case BLUE:
       return 'B';
     default:
-      fprintf(stderr, "Color not supported.\n");
-      exit(1);
+      return '?';
   }
 }
 
 
 /**
- * @brief Prints the grid.
+ * @brief Returns the description of an error.
+ * @param error An error returned by the engine.
+ * @return const char*
+ */
+const char *get_error_message(enum error error) {
+  switch (error) {
+    case NO_ERROR:
+      return "No error.";
+    case CANNOT_OPEN_FILE:
+      return "Cannot open the file.";
+    case INVALID_CHARACTER:
+      return "The file contains an invalid character.";
+    case INVALID_DIFFICULTY:
+      return "The difficulty must be between 0 and 15.";
+    case CANNOT_WRITE_FILE:
+      return "Cannot write the file.";
+    case INVALID_REPLAY:
+      return "The file is not a valid replay.";
+    case BOARD_FILE_TOO_LARGE:
+      return "The board file is too large.";
+    default:
+      return "Unknown error.";
+  }
+}
+
+
+/**
+ * @brief Writes the grid as text.
+ * @details Viruses are shown with lowercase letters and pills with uppercase ones. Empty cells are shown as `#`.
  * @param game Pointer to the game instance.
+ * @param text Where the text is written, at least `GRID_TEXT_SIZE` characters long.
  */
-void print_grid(struct game *game) {
-  // Print the header.
+void format_grid(const struct game *game, char *text) {
+  // Writes the header.
   for (int j = 0; j < COLUMNS; j++)
-    printf("=");
+    *text++ = '=';
 
-  printf("\nGRID\n");
+  text += sprintf(text, "\nGRID\n");
 
   for (int j = 0; j < COLUMNS; j++)
-    printf("=");
+    *text++ = '=';
 
-  printf("\n");
+  *text++ = '\n';
 
-  // Prints the grid.
+  // Writes the grid.
   for (int i = 0; i < ROWS; i++) {
-    if (i < 10)
-      printf("%d  ", i);
-    else
-      printf("%d ", i);
+    text += sprintf(text, i < 10 ? "%d  " : "%d ", i);
 
-    // Prints one row of cells.
+    // Writes one row of cells.
     for (int j = 0; j < COLUMNS; j++) {
-      // If there is a virus in the cell or a pill, then prints the letter correspondent to the virus's color, e.g. `R`.
-      // Use uppercase for viruses and lowercase for pills. If the cell is empty, prints `O`.
-      switch (game->grid[i][j].type) {
+      struct cell cell = get_cell(game, i, j);
+
+      switch (cell.type) {
         case VIRUS:
-          printf("%c", tolower(get_letter_color(game->grid[i][j].color)));
+          *text++ = (char) tolower(get_letter_color(cell.color));
           break;
         case PILL:
-          printf("%c", get_letter_color(game->grid[i][j].color));
+          *text++ = get_letter_color(cell.color);
           break;
         default:
-          printf("#");
+          *text++ = '#';
           break;
       }
     }
 
-    printf("\n");
+    *text++ = '\n';
   }
+
+  *text = '\0';
+}
+
+
+/**
+ * @brief Prints the grid.
+ * @param game Pointer to the game instance.
+ */
+void print_grid(struct game *game) {
+  char text[GRID_TEXT_SIZE];
+
+  format_grid(game, text);
+  fputs(text, stdout);
+}
+
+
+/**
+ * @brief Sets where the messages of the game are sent.
+ * @details Messages less important than `level` are discarded before being formatted, so a game with level `LOG_NONE`,
+ * or without a sink, doesn't spend any time on them.
+ * @param game Pointer to the game instance.
+ * @param level The least important level of the messages to be sent.
+ * @param sink The function receiving the messages, `NULL` to discard them.
+ * @param context Passed to the sink along with every message.
+ */
+void set_logger(struct game *game, enum log_level level, log_sink sink, void *context) {
+  game->logger.level = sink ? level : LOG_NONE;
+  game->logger.sink = sink;
+  game->logger.context = context;
+}
+
+
+/**
+ * @brief A sink writing the messages on a stream.
+ * @param context The `FILE` where the messages are written.
+ * @param level Level of the message.
+ * @param message The message.
+ */
+void log_to_stream(void *context, enum log_level level, const char *message) {
+  (void) level;
+  fprintf((FILE *) context, "%s\n", message);
+}
+
+
+/**
+ * @brief Returns `true` if the messages of the given level are sent to the sink.
+ * @param game Pointer to the game instance.
+ * @param level Level of the message.
+ * @return bool
+ */
+bool is_logging(const struct game *game, enum log_level level) {
+  return level != LOG_NONE && level <= game->logger.level;
+}
+
+
+/**
+ * @brief Formats a message and sends it to the sink.
+ * @param game Pointer to the game instance.
+ * @param level Level of the message.
+ * @param format The format of the message, as for `printf()`.
+ */
+void log_message(const struct game *game, enum log_level level, const char *format, ...) {
+  char message[LOG_MESSAGE_SIZE];
+  va_list args;
+
+  va_start(args, format);
+  vsnprintf(message, sizeof(message), format, args);
+  va_end(args);
+
+  game->logger.sink(game->logger.context, level, message);
+}
+
+
+/**
+ * @brief Sends the grid to the sink, after a title.
+ * @param game Pointer to the game instance.
+ * @param level Level of the message.
+ * @param title The title.
+ */
+void log_grid(const struct game *game, enum log_level level, const char *title) {
+  char text[GRID_TEXT_SIZE];
+
+  format_grid(game, text);
+
+  // The sink ends every message on its own, so the last line break of the grid is left out.
+  log_message(game, level, "\n%s\n%.*s", title, (int) strlen(text) - 1, text);
+}
+
+
+/**
+ * @brief Prepares a new game, with an empty grid and no score.
+ * @details Every random choice of the game, from the viruses of `fill_grid()` to the colors of the pills, is drawn from
+ * the generator of the game, so two games with the same seed and the same commands are identical. The logger is reset
+ * too, leaving the game silent.
+ * @param game Pointer to the game instance.
+ * @param seed Seed of the random generator.
+ */
+void init_game(struct game *game, uint64_t seed) {
+  memset(game, 0, sizeof(struct game));
+
+  game->points_multiplier = 1;
+  rng_seed(&game->rng, seed);
+
+  init_grid(game);
 }
 
 
@@ -146,14 +685,9 @@ void print_grid(struct game *game) {
  * @param game Pointer to the game instance.
  */
 void init_grid(struct game *game) {
-  for (int i = 0; i < ROWS; i++) {
-    for (int j = 0; j < COLUMNS; j++) {
-      game->grid[i][j].id = 0;
-      game->grid[i][j].type = EMPTY;
-      game->grid[i][j].color = BLANK;
-      game->grid[i][j].to_be_emptied = false;
-    }
-  }
+  memset(&game->board, 0, sizeof(struct board));
+  game->changed_cells = bb_full();
+  game->hash = hash_pill(&game->pill);
 }
 
 
@@ -165,8 +699,8 @@ void init_grid(struct game *game) {
   *   - `G` identifies a yellow virus;\n
   *   - `B` identifies a blue virus;\n
   *   - the space identifies an empty cell.\n
-  * The function verifies the presence of unwanted characters, in the event that returns an error and halt the program's
-  * execution.\n
+  * The function verifies the presence of unwanted characters, in the event that returns an error and leaves the grid
+  * empty.\n
   * The function acceps the file even in case there are some missing spaces before the line break.\n
   * The schema is then reorganised to prevent that there are two or more consecutive viruses of the same color.
   * It was decided to use this approach, instead of trigger an error for invalid scheme. The specifications,
@@ -174,16 +708,35 @@ void init_grid(struct game *game) {
   * The current implementation provides a better elasticity.
   * @param game Pointer to the game instance.
   * @param path The filepath of the text file.
+  * @return error `NO_ERROR`, or the reason why the grid could not be loaded.
   */
-void load_grid(struct game *game, char *path) {
+enum error load_grid(struct game *game, const char *path) {
   FILE *fp = fopen(path, "r");
 
-  // In case the file cannot be opened, displays an error and terminates the exection of the program.
+  // In case the file cannot be opened, returns an error.
   if (!fp) {
-    fprintf(stderr, "Cannot open the file.\n");
-    exit(1);
+    TRACE(game, LOG_ERROR, "%s: %s", path, get_error_message(CANNOT_OPEN_FILE));
+    return CANNOT_OPEN_FILE;
   }
 
+  enum error error = read_grid(game, fp, path);
+
+  fclose(fp);
+
+  return error;
+}
+
+
+/**
+ * @brief Loads the grid from a stream, in the format of the files read by `load_grid()`.
+ * @details The replays use it to load the layout they carry, so it must draw from the generator of the game exactly
+ * like `load_grid()`.
+ * @param game Pointer to the game instance.
+ * @param fp The stream, which is not closed.
+ * @param name Name of the stream, used in the messages.
+ * @return error `NO_ERROR`, or the reason why the grid could not be loaded.
+ */
+enum error read_grid(struct game *game, FILE *fp, const char *name) {
   // Variable used to store the character read.
   int character;
 
@@ -195,18 +748,15 @@ void load_grid(struct game *game, char *path) {
 
     switch (character) {
       case 'R':
-        game->grid[x][y].type = VIRUS;
-        game->grid[x][y].color = RED;
+        set_cell(game, x, y, VIRUS, RED);
         y++;
         break;
       case 'Y':
-        game->grid[x][y].type = VIRUS;
-        game->grid[x][y].color = YELLOW;
+        set_cell(game, x, y, VIRUS, YELLOW);
         y++;
         break;
       case 'B':
-        game->grid[x][y].type = VIRUS;
-        game->grid[x][y].color = BLUE;
+        set_cell(game, x, y, VIRUS, BLUE);
         y++;
         break;
       case ' ':
@@ -219,46 +769,51 @@ void load_grid(struct game *game, char *path) {
       case EOF:
         break;
       default:
-        fprintf(stderr, "The file contains an invalid character.\n");
-        exit(1);
+        init_grid(game);
+        TRACE(game, LOG_ERROR, "%s:%d: %s", name, x + 1, get_error_message(INVALID_CHARACTER));
+        return INVALID_CHARACTER;
     }
 
   } while (character != EOF);
 
-  fclose(fp);
-
   reorganize_viruses(game);
 
-  printf("\ninitial grid\n");
-  print_grid(game);
+  // A file may contain groups of viruses of the same color, therefore the whole grid is checked after the first pill.
+  game->changed_cells = bb_full();
+
+  TRACE_GRID(game, LOG_INFO, "initial grid");
+
+  return NO_ERROR;
 }
 
 
 /**
  * @brief Initializes a vector assigning to each element a value between 0 and 2.
+ * @param rng The random generator of the game.
  * @param vector A vector of integers.
  * @param n The vector's dimension.
  */
-void generate_viruses(int *vector, int n) {
+void generate_viruses(struct rng *rng, int *vector, int n) {
   for (int i = 0; i < n; i++) {
     // Assigns a number included between 0 and 2 to the cell, who represent the virus color.
-    vector[i] = (rand() % 3);
+    vector[i] = (int) rng_below(rng, 3);
   }
 }
 
 
 /**
  * @brief Shuffle a vector.
+ * @param rng The random generator of the game.
  * @param vector A vector of integers.
  * @param n The vector's dimension.
  * @details The function uses the Fisher–Yates shuffle.
  * @see https://en.wikipedia.org/wiki/Fisher%E2%80%93Yates_shuffle#The_modern_algorithm
  */
-void shuffle_viruses(int *vector, int n) {
+void shuffle_viruses(struct rng *rng, int *vector, int n) {
   int i, j, tmp;
 
   for (i = n - 1; i > 0; i--) {
-    j = rand() % (i + 1);
+    j = (int) rng_below(rng, (uint32_t) i + 1);
     tmp = vector[j];
     vector[j] = vector[i];
     vector[i] = tmp;
@@ -268,15 +823,16 @@ void shuffle_viruses(int *vector, int n) {
 
 /**
  * @brief Assign the value `-1` to a number `r` of vector's elements randomly selected.
+ * @param rng The random generator of the game.
  * @param vector A vector of integers.
  * @param n Vector's dimension.
  * @param r Number of elements to be removed.
  */
-void prune_viruses(int *vector, int n, int r) {
+void prune_viruses(struct rng *rng, int *vector, int n, int r) {
   int k = 0;
 
   while (k < r) {
-    int i = rand() % n;
+    int i = (int) rng_below(rng, (uint32_t) n);
 
     if (vector[i] == -1)
       continue;
@@ -299,7 +855,7 @@ void assign_viruses(struct game *game, const int *vector) {
   // The first 5 cells of the grid must be empty because they cannot contain viruses.
   for (i = 0; i < INVALIDE_ROWS; i++) {
     for (j = 0; j < COLUMNS; j++)
-      game->grid[i][j].type = EMPTY;
+      clear_cell(game, i, j);
   }
 
   // To the other cells, monsters will be assigned.
@@ -308,13 +864,10 @@ void assign_viruses(struct game *game, const int *vector) {
   for (i = INVALIDE_ROWS; i < ROWS; i++) {
     for (j = 0; j < COLUMNS; j++) {
 
-      if (vector[k] != -1) {
-        game->grid[i][j].type = VIRUS;
-        game->grid[i][j].color = (enum color) vector[k];
-      }
-      else {
-        game->grid[i][j].type = EMPTY;
-      }
+      if (vector[k] != -1)
+        set_cell(game, i, j, VIRUS, (enum color) vector[k]);
+      else
+        clear_cell(game, i, j);
 
       k++;
     }
@@ -334,13 +887,17 @@ void assign_viruses(struct game *game, const int *vector) {
  *   - verifies there aren't two consecutive viruses on the same line.
  * @param game Pointer to the game instance.
  * @param difficulty Level of difficulty chosen for the game, between 0 and 15.
+ * @return error `NO_ERROR`, or `INVALID_DIFFICULTY` leaving the grid untouched.
  * @note The algorithm assumes you cannot have more then two consecutive viruses, of the same type, on the same row or
  * column. The specifications are not very clear on this point, since there is a mention to the word "line". From the
  * images I have inferred the verification is done on both row and column.
  */
-void fill_grid(struct game *game, int difficulty) {
+enum error fill_grid(struct game *game, int difficulty) {
   // Verifies that the level of difficulty is between 0 e 15. If not it returns an error.
-  assert(difficulty >= 0 && difficulty <= 15);
+  if (difficulty < 0 || difficulty > 15) {
+    TRACE(game, LOG_ERROR, "%d: %s", difficulty, get_error_message(INVALID_DIFFICULTY));
+    return INVALID_DIFFICULTY;
+  }
 
   // Number of available cells. The first five rows of cells cannot be used.
   const int cell_count = (ROWS * COLUMNS) - (INVALIDE_ROWS * COLUMNS);
@@ -351,11 +908,15 @@ void fill_grid(struct game *game, int difficulty) {
   // Declares a vector with only the cells available on the grid, to be used later to assign the viruses.
   int cells[cell_count];
 
-  generate_viruses(cells, cell_count);
-  prune_viruses(cells, cell_count, virus_count);
-  shuffle_viruses(cells, cell_count);
+  generate_viruses(&game->rng, cells, cell_count);
+  prune_viruses(&game->rng, cells, cell_count, virus_count);
+  shuffle_viruses(&game->rng, cells, cell_count);
   assign_viruses(game, cells);
   reorganize_viruses(game);
+
+  game->changed_cells = bb_full();
+
+  return NO_ERROR;
 }
 
 
@@ -371,59 +932,95 @@ void swap_color(struct pill *pill) {
 
 
 /**
- * @brief Marks a group of four or more cells of a line (row or column) having the same color.
- * @details The marked cells can be emptied, all together, in a following step.
+ * @brief Finds the groups of four or more cells of a line (row or column) among the cells of every color.
+ * @details Every color is processed as a whole, shifting its mask instead of walking the lines one cell at a time.
+ * With AVX2, red and yellow are processed together, one in each lane.
+ * @param cells The cells of every color.
+ * @return bitboard The cells of the groups.
+ */
+bitboard find_color_runs(const bitboard cells[BLANK]) {
+#if defined(__AVX2__)
+  return bb_or(bb_runs2(cells[RED], cells[YELLOW], MIN_ELEMENTS), bb_runs(cells[BLUE], MIN_ELEMENTS));
+#else
+  bitboard matches = bb_zero();
+
+  for (int color = RED; color < BLANK; color++)
+    matches = bb_or(matches, bb_runs(cells[color], MIN_ELEMENTS));
+
+  return matches;
+#endif
+}
+
+
+/**
+ * @brief Finds the groups of four or more cells of a line (row or column) having the same color.
+ * @details The cells found can be emptied, all together, in a following step.
+ * @param board Pointer to the board.
+ * @return bitboard The cells to be emptied.
+ */
+bitboard find_matches(const struct board *board) {
+  return find_color_runs(board->color);
+}
+
+
+/**
+ * @brief Returns, for every color, its cells on the rows and columns crossing the cells changed since the last check.
+ * The colors with no changed cells are left out.
+ * @param game Pointer to the game instance.
+ * @param cells The cells of every color to be checked.
+ */
+void get_changed_lines(const struct game *game, bitboard cells[BLANK]) {
+  bitboard changed = game->changed_cells;
+  bitboard lines = bb_or(bb_rows(changed), bb_columns(changed));
+
+  for (int color = RED; color < BLANK; color++)
+    cells[color] = bb_any(bb_and(game->board.color[color], changed)) ? bb_and(game->board.color[color], lines) : bb_zero();
+}
+
+
+/**
+ * @brief Finds the groups of four or more cells of a line having the same color, checking only the lines which cross
+ * the cells changed since the last check.
+ * @details The grid never holds a group once it has been processed, so a new group must contain at least one of the
+ * changed cells. Only the colors of such cells, on the rows and columns crossing them, need to be checked. Building
+ * with `DRMAURO_CHECK_MATCHES` verifies the result against a full scan of the grid.
  * @param game Pointer to the game instance.
- * @param direction Direction of the line,
- * @param index Index of the line (row o column) to be processed.
- * @param offset Position on the row or column.
- * @param repetitions Number of repetitions.
+ * @return bitboard The cells to be emptied.
  */
-void mark_cells_for_emptying(struct game *game, enum direction direction, int index, int offset, int repetitions) {
+bitboard find_changed_matches(struct game *game) {
+  bitboard cells[BLANK];
+  bitboard matches;
 
-  for (int i = repetitions; i >= 0; i--) {
-    switch (direction) {
-      case HORIZONTAL:
-        game->grid[index][offset - i].to_be_emptied = true;
-        break;
-      case VERTICAL:
-        game->grid[offset - i][index].to_be_emptied = true;
-        break;
-    }
-  }
+  get_changed_lines(game, cells);
+  matches = find_color_runs(cells);
+
+#ifdef DRMAURO_CHECK_MATCHES
+  assert(bb_equal(matches, find_matches(&game->board)));
+#endif
 
+  game->changed_cells = bb_zero();
+
+  return matches;
 }
 
 
 /**
  * @brief Empty the marked cells.
  * @param game Pointer to the game instance.
+ * @param to_be_emptied The marked cells.
  * @return bool Returns `true` if any cells have been emptied, `false` otherwise.
  */
-bool empty_cells(struct game *game) {
-  bool is_changed = false;
-  struct cell *cell;
-  int virus_killed = 0;
-
+bool empty_cells(struct game *game, const bitboard *to_be_emptied) {
+  bool is_changed = bb_any(*to_be_emptied);
 
-  for (int r = 0; r < ROWS; r++) {
-    for (int c = 0; c < COLUMNS; c++) {
-      cell = &game->grid[r][c];
+  // Viruses and halves are removed all together, masking out the marked cells.
+  int virus_killed = bb_count(bb_and(game->board.virus, *to_be_emptied));
 
-      if (cell->to_be_emptied) {
+  bitboard cells = *to_be_emptied;
+  int r, c;
 
-        if (cell->type == VIRUS)
-          virus_killed++;
-
-        cell->id = 0;
-        cell->type = EMPTY;
-        cell->color = BLANK;
-        cell->to_be_emptied = false;
-
-        is_changed = true;
-      }
-    }
-  }
+  while (bb_pop(&cells, &r, &c))
+    clear_cell(game, r, c);
 
   int points = 0;
   for (int i = 1; i <= virus_killed; i++)
@@ -435,65 +1032,12 @@ bool empty_cells(struct game *game) {
     game->points_multiplier *= 2;
   }
 
-  printf("\nadjacent pills and viruses have been removed from the grid\n");
-  print_grid(game);
+  TRACE_GRID(game, LOG_DEBUG, "adjacent pills and viruses have been removed from the grid");
 
   return is_changed;
 }
 
 
-/**
- * @brief Process a single line of the grid, (row or column), so that monsters or pills' halves can be eliminated.
- * @param game Pointer to the game instance.
- * @param direction Horizontal for x-axis or vertical for y-axis.
- * @param index Index of the line (row o column) to be processed.
- */
-void process_line(struct game *game, enum direction direction, int index) {
-  int i = index;
-
-  int limit;
-  int repetitions = 0;
-
-  if (direction == HORIZONTAL)
-    limit = COLUMNS - 1;
-  else
-    limit = ROWS - 1;
-
-  for (int j = 0; j < limit; j++) {
-    struct cell *next_cell;
-    struct cell *current_cell;
-
-    // Determine the current cell and the next one in function of the direction.
-    if (direction == HORIZONTAL) {
-      current_cell = &game->grid[i][j];
-      next_cell = &game->grid[i][j+1];
-    }
-    else {
-      current_cell = &game->grid[j][i];
-      next_cell = &game->grid[j+1][i];
-    }
-
-    if (current_cell->color == BLANK) {
-      repetitions = 0;
-      continue;
-    }
-
-    if (current_cell->color == next_cell->color) {
-      repetitions++;
-
-      if (j+1 == limit && repetitions >= MIN_ELEMENTS-1)
-        mark_cells_for_emptying(game, direction, i, limit, repetitions);
-    }
-    else {
-      if (repetitions >= MIN_ELEMENTS-1)
-        mark_cells_for_emptying(game, direction, i, j, repetitions);
-
-      repetitions = 0;
-    }
-  }
-}
-
-
 /**
  * @brief Given the coordinates of a cell, returns the last empty cell row.
  * @param game Pointer to the game instance.
@@ -503,16 +1047,14 @@ void process_line(struct game *game, enum direction direction, int index) {
  * @return int
  */
 int get_empty_cell_row_by_column(struct game *game, enum direction orientation, int row, int column) {
-  int r = row;
-  int c = column;
+  int r = get_landing_row(game, row, column);
 
-  while (r < ROWS-1) {
-
-    if (game->grid[r+1][c].type == EMPTY && (orientation == VERTICAL || (orientation == HORIZONTAL && game->grid[r+1][c+1].type == EMPTY)))
-      r++;
-    else
-      break;
+  // A horizontal pill stops as soon as one of its halves finds an occupied cell.
+  if (orientation == HORIZONTAL) {
+    int second_row = get_landing_row(game, row, column + 1);
 
+    if (second_row < r)
+      r = second_row;
   }
 
   return r;
@@ -520,149 +1062,156 @@ int get_empty_cell_row_by_column(struct game *game, enum direction orientation,
 
 
 /**
- * @brief Move the pill's halves down to the end of stroke.
- * @param first_half First half of the pill.
- * @param second_half Second half of the pill.
- * @param target_first_half Target cell for the first half of the pill.
- * @param target_second_half Target cell for the second half of the pill.
+ * @brief Drops by one row all the fragments of the board which are free to fall.
+ * @details A single half is free to fall when the cell below is empty, a vertical pill when the cell below its lower
+ * half is, and a horizontal pill only when the cells below both halves are. Every step costs the same few mask
+ * operations, however many fragments are falling.
+ * @param board Pointer to the board.
+ * @return bitboard The cells which have fallen, where they were before falling.
  */
-void move_halves(struct cell *first_half, struct cell *second_half,
-                 struct cell *target_first_half, struct cell *target_second_half) {
+bitboard drop_fragments(struct board *board) {
+  bitboard occupied = get_occupied_cells(board);
+  bitboard left_halves = board->link[HORIZONTAL];
+  bitboard right_halves = bb_right(left_halves);
+  bitboard upper_halves = board->link[VERTICAL];
+  bitboard lower_halves = bb_down(upper_halves);
 
-  target_first_half->id = first_half->id;
-  target_first_half->type = first_half->type;
-  target_first_half->color = first_half->color;
+  // We can only drop pill's halves, not the viruses. The halves which are not joined to any other one fall alone.
+  bitboard single_halves = bb_andnot(bb_andnot(occupied, board->virus),
+                                     bb_or(bb_or(left_halves, right_halves), bb_or(upper_halves, lower_halves)));
 
-  first_half->id = 0;
-  first_half->type = EMPTY;
-  first_half->color = BLANK;
+  // The cells with an empty cell below. The ones on the last row are already on the bottom of the grid.
+  bitboard free = bb_andnot(bb_andnot(bb_full(), bb_up(occupied)), bb_row(ROWS - 1));
 
-  if (!second_half)
-    return;
+  // A vertical pill falls with its lower half, a horizontal one only if both its halves are free.
+  bitboard falling_lower_halves = bb_and(lower_halves, free);
+  bitboard falling_left_halves = bb_and(bb_and(left_halves, free), bb_left(bb_and(right_halves, free)));
+
+  bitboard falling = bb_or(bb_and(single_halves, free),
+                           bb_or(bb_or(falling_lower_halves, bb_up(falling_lower_halves)),
+                                 bb_or(falling_left_halves, bb_right(falling_left_halves))));
+
+  if (!bb_any(falling))
+    return falling;
+
+  for (int color = RED; color < BLANK; color++)
+    board->color[color] = bb_fall(board->color[color], falling);
+
+  board->link[HORIZONTAL] = bb_fall(board->link[HORIZONTAL], falling);
+  board->link[VERTICAL] = bb_fall(board->link[VERTICAL], falling);
+
+  return falling;
+}
+
+
+/**
+ * @brief Stores the board shaken, updating the hash, and marks the cells where the fragments landed as changed.
+ * @param game Pointer to the game instance.
+ * @param board The board shaken.
+ * @param moved The cells where the fragments landed.
+ * @return bool Returns `true` if the grid changed and need to be processed again.
+ */
+bool end_shake(struct game *game, const struct board *board, const bitboard *moved) {
+  game->hash ^= hash_board_change(&game->board, board);
+  game->board = *board;
+  game->changed_cells = bb_or(game->changed_cells, *moved);
 
-  target_second_half->id = second_half->id;
-  target_second_half->type = second_half->type;
-  target_second_half->color = second_half->color;
+  TRACE_GRID(game, LOG_DEBUG, "the grid has been shaked");
 
-  second_half->id = 0;
-  second_half->type = EMPTY;
-  second_half->color = BLANK;
+  return bb_any(*moved);
 }
 
 
 /**
  * @brief After the grid has been processed, shakes the grid so the pill's halves can drop till they find a virus, another
  * pill or the bottom of the grid.
+ * @details All the fragments which are free to fall move one row down at the same time, and the step is repeated until
+ * none of them can move.
  * @param game Pointer to the game instance.
  * @return bool Returns `true` if the grid changed and need to be processed again.
  */
 bool shake_grid(struct game *game) {
-  bool is_changed = false;
-
-  // Because halves on the row 16 (which is identified as 15, since we start from 0) are already on the bottom of the
-  // grid, therefore cannot fall, we start when `i` is equal to 14, so we do not process the last row. We also process
-  // the rows from the bottom to the top, so in the inverse order, consider 0,0 is in the top left corner of the grid.
-  for (int r = ROWS - 2; r > 0; r--) {
-    for (int c = 0; c < COLUMNS; c++) {
-      int new_row;
-
-      // We can only drop pill's halves, not the viruses.
-      if (game->grid[r][c].type == PILL) {
-        // Now we know it's a pill fragment, we need to check if there is any adjacent fragment, which is part of the
-        // same pill. To be sure the other half belongs to the same pill, the ID has to match.
-        struct cell *first_half = &game->grid[r][c];
-
-        // We have to check if the is there is one part of the pill above, because we start from the bottom.
-        if (game->grid[r][c].id == game->grid[r-1][c].id) {
-          // If the other half of the pill is above, then the pill can be dropped, without any further check.
-
-          new_row = get_empty_cell_row_by_column(game, VERTICAL, r, c);
-
-          if (new_row != r) {
-            struct cell *second_half = &game->grid[r-1][c];
-            struct cell *target_first_half = &game->grid[new_row][c];
-            struct cell *target_second_half = &game->grid[new_row-1][c];
-
-            move_halves(first_half, second_half, target_first_half, target_second_half);
-            is_changed = true;
-          }
-
-          continue;
-        }
-
-        // In case the other half is not above, can be beside.
-        if (c+1 < ROWS && game->grid[r][c].id == game->grid[r][c+1].id) {
-          new_row = get_empty_cell_row_by_column(game, HORIZONTAL, r, c);
-
-          if (new_row != r) {
-            struct cell *second_half = &game->grid[r][c+1];
-            struct cell *target_first_half = &game->grid[new_row][c];
-            struct cell *target_second_half = &game->grid[new_row][c+1];
-
-            move_halves(first_half, second_half, target_first_half, target_second_half);
-            is_changed = true;
-
-            // We increment `c` so we do not check the next fragment again. This will skip the next column `c+1`, because
-            // it has been already processed for the current row `r`.
-            //c++;
-          }
-
-          // In case the other half is beside, we need to check if cells below the halves are both empty.
-          continue;
-        }
-
-        // The pill can be dropped because it's constituted of a single fragment.
-        new_row = get_empty_cell_row_by_column(game, VERTICAL, r, c);
-
-        if (new_row != r) {
-          struct cell *target_first_half = &game->grid[new_row][c];
-          move_halves(first_half, NULL, target_first_half, NULL);
-          is_changed = true;
-        }
-      }
+  struct board board = game->board;
+  bitboard moved = bb_zero();
 
-    }
+  for (;;) {
+    bitboard falling = drop_fragments(&board);
 
-  }
+    if (!bb_any(falling))
+      break;
 
-  printf("\nthe grid has been shaked\n");
-  print_grid(game);
+    // The cells moved so far follow the fragments, so at the end they are where the fragments landed.
+    moved = bb_fall(bb_or(moved, falling), falling);
+  }
 
-  return is_changed;
+  return end_shake(game, &board, &moved);
 }
 
 
 /**
- * @brief Process the entire grid as consequence of a new command.
+ * @brief Empties the groups found by a step of the cascade, and records the step.
  * @param game Pointer to the game instance.
+ * @param matches The cells to be emptied.
+ * @return bool Returns `false` if there was nothing to empty, so the cascade is over.
  */
-void process_grid(struct game *game) {
-  if (game->pill.active)
-    return;
+bool clear_matches(struct game *game, const bitboard *matches) {
+  struct cascade *cascade = &game->cascade;
+  int score = game->score;
 
-  for (int i = ROWS-1; i >= 0; i--)
-    process_line(game, HORIZONTAL, i);
+  // If the pill didn't kill any viruses, or it didn't clear other pills, then the cascade is over, because there is
+  // no need for shaking and processing.
+  if (!empty_cells(game, matches))
+    return false;
 
-  for (int i = 0; i < COLUMNS; i++)
-    process_line(game, VERTICAL, i);
+  cascade->cleared[cascade->steps] = bb_count(*matches);
+  cascade->score[cascade->steps] = game->score - score;
+  cascade->steps++;
 
-  // If the pill didn't kill any viruses, or it didn't clear other pills, then the function return, because there is no
-  // need for shaking and processing.
-  if (!empty_cells(game))
-    return;
+  return true;
+}
 
-  // Call itself recursively if there was any change in the grid.
-  if (shake_grid(game)) {
-    process_grid(game);
-  }
+
+/**
+ * @brief Closes the cascade, checking whether the last virus has been killed.
+ * @param game Pointer to the game instance.
+ */
+void end_cascade(struct game *game) {
+  if (game->cascade.steps == 0)
+    return;
 
   // After we have shaken the grid, even multiple times, the multiplier has to be reinstated to the initial value.
   game->points_multiplier = 1;
 
-  if (game->virus_count == 0) {
+  if (game->virus_count == 0)
     game->status = VICTORY;
+}
+
+
+/**
+ * @brief Process the entire grid as consequence of a new command.
+ * @details Groups of cells are emptied and the grid is shaken until no other group is formed. Every step empties at
+ * least `MIN_ELEMENTS` cells, so the cascade cannot last more than `MAX_CASCADE_STEPS` steps. The steps are recorded
+ * in `game->cascade`.
+ * @param game Pointer to the game instance.
+ */
+void process_grid(struct game *game) {
+  if (game->pill.active)
     return;
+
+  game->cascade.steps = 0;
+
+  while (game->cascade.steps < MAX_CASCADE_STEPS) {
+    bitboard to_be_emptied = find_changed_matches(game);
+
+    if (!clear_matches(game, &to_be_emptied))
+      break;
+
+    // Process the grid again only if there was any change in it.
+    if (!shake_grid(game))
+      break;
   }
+
+  end_cascade(game);
 }
 
 
@@ -676,12 +1225,8 @@ void remove_active_pill_from_grid(struct game *game) {
   if (!p->active)
     return;
 
-  game->grid[p->first_half.row][p->first_half.column].id = 0;
-  game->grid[p->second_half.row][p->second_half.column].id = 0;
-  game->grid[p->first_half.row][p->first_half.column].type = EMPTY;
-  game->grid[p->second_half.row][p->second_half.column].type = EMPTY;
-  game->grid[p->first_half.row][p->first_half.column].color = BLANK;
-  game->grid[p->second_half.row][p->second_half.column].color = BLANK;
+  clear_cell(game, p->first_half.row, p->first_half.column);
+  clear_cell(game, p->second_half.row, p->second_half.column);
 }
 
 
@@ -695,25 +1240,23 @@ void restore_active_pill_to_grid(struct game *game) {
   if (!p->active)
     return;
 
-  game->grid[p->first_half.row][p->first_half.column].id = p->id;
-  game->grid[p->second_half.row][p->second_half.column].id = p->id;
-  game->grid[p->first_half.row][p->first_half.column].type = PILL;
-  game->grid[p->second_half.row][p->second_half.column].type = PILL;
-  game->grid[p->first_half.row][p->first_half.column].color = p->first_half.color;
-  game->grid[p->second_half.row][p->second_half.column].color = p->second_half.color;
+  set_cell(game, p->first_half.row, p->first_half.column, PILL, p->first_half.color);
+  set_cell(game, p->second_half.row, p->second_half.column, PILL, p->second_half.color);
+  link_halves(game, &p->first_half, &p->second_half);
 }
 
 
 /**
- * @brief Refreshes the grid because the pill moved.
+ * @brief Moves the pill on the grid where the last command brought it, if there is room.
  * @param game Pointer to the game instance.
+ * @return bool Returns `true` if the pill has landed, so the grid must be processed.
  */
-void refresh_grid(struct game *game) {
+bool place_pill(struct game *game) {
   struct pill *pill = &game->pill;
   struct pill *moving_pill = &game->moving_pill;
 
   if (!pill->active )
-    return;
+    return false;
 
   // New coordinates of the pill's halves.
   int r1 = moving_pill->first_half.row;
@@ -728,14 +1271,14 @@ void refresh_grid(struct game *game) {
   // and the control returns to the caller function.
   if (r1 > ROWS - 1 || c1 > COLUMNS - 1 || r2 > ROWS - 1 || c2 > COLUMNS - 1 || c1 < 0 || c2 < 0) {
     restore_active_pill_to_grid(game);
-    return;
+    return false;
   }
 
   // The command is invalid even if only one half of the pill occupies a cell that is not empty.
   // (r1, c1) e (r2, c2) are the coordinates of the cells that the pills should occupy.
   // The check `r2 >= 0` is there to avoid that the program terminates, in which case the pill is vertical oriented and
   // exceeds the grid. `r2`, in fact, could be equal to `-1`, which is outside the grid perimeter.
-  if ((game->grid[r1][c1].type != EMPTY) || (r2 >= 0 && game->grid[r2][c2].type != EMPTY)) {
+  if (!is_empty_cell(game, r1, c1) || (r2 >= 0 && !is_empty_cell(game, r2, c2))) {
 
     // In such a case a further check has to be done to be sure the pill is exactly in the middle of the first row. If
     // so, in virtue of the fact the cells are already taken, the game is over, therefore the state of the game doesn't
@@ -744,37 +1287,49 @@ void refresh_grid(struct game *game) {
       game->status = DEFEAT;
 
     restore_active_pill_to_grid(game);
-    return;
+    return false;
   }
 
   // REPOSITION THE PILL
 
   // Inserts the first half of the pill on the grid.
-  game->grid[r1][c1].id = moving_pill->id;
-  game->grid[r1][c1].type = PILL;
-  game->grid[r1][c1].color = moving_pill->first_half.color;
+  set_cell(game, r1, c1, PILL, moving_pill->first_half.color);
 
   // Proceeds with the second half if inside the grid.
-  game->grid[r2][c2].id = moving_pill->id;
-  game->grid[r2][c2].type = PILL;
-  game->grid[r2][c2].color = moving_pill->second_half.color;
+  set_cell(game, r2, c2, PILL, moving_pill->second_half.color);
+  link_halves(game, &moving_pill->first_half, &moving_pill->second_half);
 
   // A pill gets deactivated when reaches the end of stroke, therefore in the following cases:
   //   - it's at the bottom, namely the last row of the grid;
   //   - below the first half there is not an empty cell, but a virus or a pill;
   //   - when the pill is horizontal and below the second half there is not an empty cell.
   if (r1 == ROWS - 1 ||
-      (game->grid[r1+1][c1].type != EMPTY) ||
-      (moving_pill->orientation == HORIZONTAL && game->grid[r2 + 1][c2].type != EMPTY)) {
+      !is_empty_cell(game, r1+1, c1) ||
+      (moving_pill->orientation == HORIZONTAL && !is_empty_cell(game, r2 + 1, c2))) {
     moving_pill->active = false;
+
+    // Only the lines crossing the pill which has just landed can hold new groups of cells of the same color.
+    mark_cell_changed(game, r1, c1);
+    mark_cell_changed(game, r2, c2);
   }
 
   // Assigns to the active pill, the copy.
+  game->hash ^= hash_pill(pill) ^ hash_pill(moving_pill);
   memcpy(pill, moving_pill, sizeof(struct pill));
 
   game->status = RUNNING;
 
-  process_grid(game);
+  return !pill->active;
+}
+
+
+/**
+ * @brief Refreshes the grid because the pill moved.
+ * @param game Pointer to the game instance.
+ */
+void refresh_grid(struct game *game) {
+  if (place_pill(game))
+    process_grid(game);
 }
 
 
@@ -808,7 +1363,7 @@ void rotate_pill(struct game *game, enum rotation direction) {
       temp.second_half.column++;
 
       // If the second half of the pill ends on an occupied cell, then shift to the left the entire pill.
-      if (temp.second_half.column == COLUMNS || game->grid[temp.second_half.row][temp.second_half.column].type != EMPTY) {
+      if (temp.second_half.column == COLUMNS || !is_empty_cell(game, temp.second_half.row, temp.second_half.column)) {
         temp.first_half.column--;
         temp.second_half.column--;
       }
@@ -852,23 +1407,16 @@ void move_pill(struct game *game, enum command direction) {
       break;
 
     case DOWN: {
-      int i = temp.first_half.row + 1;
-
-      while (i < ROWS) {
-        // If there is no place for the pill then it stops.
-        if (game->grid[i][temp.first_half.column].type != EMPTY || game->grid[i][temp.second_half.column].type != EMPTY)
-          break;
-
-        i++;
-      }
+      // The pill stops above the first occupied cell found below any of its halves.
+      int row = get_empty_cell_row_by_column(game, temp.orientation, temp.first_half.row, temp.first_half.column);
 
       // Move the pill down.
-      temp.first_half.row = i - 1;
+      temp.first_half.row = row;
 
       if (temp.orientation == HORIZONTAL)
-        temp.second_half.row = i - 1;
+        temp.second_half.row = row;
       else
-        temp.second_half.row = i - 2;
+        temp.second_half.row = row - 1;
     }
       break;
 
@@ -891,6 +1439,9 @@ void move_pill(struct game *game, enum command direction) {
  * @param game Pointer to the game instance.
  */
 void create_pill(struct game *game) {
+  // The hash of an inactive pill is 0.
+  assert(!game->pill.active);
+
   game->pill.orientation = HORIZONTAL;
 
   // The x-axis is `-1` because the pill is positioned in the first valid raw of the grid.
@@ -902,8 +1453,8 @@ void create_pill(struct game *game) {
   game->pill.second_half.column = game->pill.first_half.column + 1;
 
   // A random color is assigned to the pill.
-  game->pill.first_half.color = (enum color) get_random_color();
-  game->pill.second_half.color = (enum color) get_random_color();
+  game->pill.first_half.color = (enum color) get_random_color(game);
+  game->pill.second_half.color = (enum color) get_random_color(game);
 
   // DEBUG ONLY
   //game->pill.first_half.color = (enum color) RED;
@@ -911,10 +1462,8 @@ void create_pill(struct game *game) {
 
   game->pills_count++;
 
-  // Every pill must have an identifier. It is used to identify two halves of the same pill in the grid.
-  game->pill.id = game->pills_count;
-
   game->pill.active = true;
+  game->hash ^= hash_pill(&game->pill);
 
   // When we create a new pill, we also move it at the center top of the grid, therefore the moving pill coincides with
   // the pill.
@@ -923,14 +1472,14 @@ void create_pill(struct game *game) {
 
 
 /**
- * @brief Executes a command.
+ * @brief Moves the pill as requested by a command, without refreshing the grid.
  * @details A player can move the pill to the left or right, rotate it clockwise or anti-clockwise, drop it towards the
  * bottom of the grid. In case there is no input, the program will drop the pill on one position at the time. If there
  * is not an active pill, one will be created and positioned in the middle of the first valid row.
  * @param game Pointer to the game instance.
  * @param command Command given by the player.
  */
-void execute(struct game *game, enum command command) {
+void apply_command(struct game *game, enum command command) {
 
   switch (command) {
     case RIGHT:
@@ -962,8 +1511,21 @@ void execute(struct game *game, enum command command) {
     default:
       break;
   }
+}
 
+
+/**
+ * @brief Executes a command.
+ * @param game Pointer to the game instance.
+ * @param command Command given by the player.
+ */
+void execute(struct game *game, enum command command) {
+  apply_command(game, command);
   refresh_grid(game);
+
+#ifdef DRMAURO_CHECK_HASH
+  assert(game->hash == compute_hash(game));
+#endif
 }
 
 
@@ -975,3 +1537,428 @@ void execute(struct game *game, enum command command) {
 enum state victory(struct game *game) {
   return game->status;
 }
+
+
+/**
+ * @brief Packs the position and the color of a half in 10 bits.
+ * @details Rows start from `-PILL_ROW_OFFSET`, since a pill rotated where it appears sticks out of the grid.
+ * @param halve The half.
+ * @return uint32_t
+ */
+uint32_t pack_halve(const struct halve *halve) {
+  assert(halve->row + PILL_ROW_OFFSET >= 0 && halve->row + PILL_ROW_OFFSET < 32);
+  assert(halve->column >= 0 && halve->column < COLUMNS);
+
+  return (uint32_t) (halve->row + PILL_ROW_OFFSET) | (uint32_t) halve->column << 5 | (uint32_t) halve->color << 8;
+}
+
+
+/**
+ * @brief Unpacks a half packed by `pack_halve()`.
+ * @param bits The packed half.
+ * @param halve The half.
+ */
+void unpack_halve(uint32_t bits, struct halve *halve) {
+  halve->row = (int) (bits & 0x1f) - PILL_ROW_OFFSET;
+  halve->column = (int) (bits >> 5 & 0x07);
+  halve->color = (enum color) (bits >> 8 & 0x03);
+}
+
+
+/**
+ * @brief Takes a snapshot of a game, between two ticks.
+ * @param game Pointer to the game instance.
+ * @param snapshot The snapshot.
+ */
+void game_snapshot(const struct game *game, struct snapshot *snapshot) {
+  const struct board *board = &game->board;
+  const struct pill *pill = &game->pill;
+
+  snapshot->color_bits[0] = bb_or(board->color[RED], board->color[BLUE]);
+  snapshot->color_bits[1] = bb_or(board->color[YELLOW], board->color[BLUE]);
+  snapshot->kind_bits[0] = bb_or(board->virus, board->link[VERTICAL]);
+  snapshot->kind_bits[1] = bb_or(board->link[HORIZONTAL], board->link[VERTICAL]);
+  snapshot->rng = game->rng;
+  snapshot->score = game->score;
+  snapshot->pills_count = game->pills_count;
+  snapshot->points_multiplier = game->points_multiplier;
+  snapshot->hash = game->hash;
+
+  assert(game->virus_count >= INT8_MIN && game->virus_count <= INT8_MAX);
+
+  snapshot->pill = (uint32_t) game->status | (uint32_t) (uint8_t) game->virus_count << 2;
+
+  if (pill->active)
+    snapshot->pill |= 1u << 10 | (uint32_t) pill->orientation << 11 | pack_halve(&pill->first_half) << 12 |
+                      pack_halve(&pill->second_half) << 22;
+}
+
+
+/**
+ * @brief Brings a game back to the state of a snapshot. The logger of the game is kept.
+ * @details All the cells are marked as changed, which only costs a full scan when the next pill lands: a grid between
+ * two ticks holds no groups but the ones crossing the cells changed since.
+ * @param game Pointer to the game instance.
+ * @param snapshot The snapshot.
+ */
+void game_restore(struct game *game, const struct snapshot *snapshot) {
+  struct board *board = &game->board;
+  struct pill *pill = &game->pill;
+  bitboard kind = snapshot->kind_bits[0], linked = snapshot->kind_bits[1];
+
+  board->color[RED] = bb_andnot(snapshot->color_bits[0], snapshot->color_bits[1]);
+  board->color[YELLOW] = bb_andnot(snapshot->color_bits[1], snapshot->color_bits[0]);
+  board->color[BLUE] = bb_and(snapshot->color_bits[0], snapshot->color_bits[1]);
+  board->virus = bb_andnot(kind, linked);
+  board->link[HORIZONTAL] = bb_andnot(linked, kind);
+  board->link[VERTICAL] = bb_and(kind, linked);
+
+  game->changed_cells = bb_full();
+  game->rng = snapshot->rng;
+  game->score = snapshot->score;
+  game->pills_count = snapshot->pills_count;
+  game->points_multiplier = snapshot->points_multiplier;
+  game->hash = snapshot->hash;
+  game->status = (enum state) (snapshot->pill & 0x03);
+  game->virus_count = (int8_t) (snapshot->pill >> 2 & 0xff);
+  game->cascade.steps = 0;
+
+  memset(pill, 0, sizeof(struct pill));
+  pill->active = snapshot->pill >> 10 & 1;
+
+  if (pill->active) {
+    pill->orientation = (enum direction) (snapshot->pill >> 11 & 1);
+    unpack_halve(snapshot->pill >> 12 & 0x3ff, &pill->first_half);
+    unpack_halve(snapshot->pill >> 22, &pill->second_half);
+  }
+
+  game->moving_pill = *pill;
+}
+
+
+/**
+ * @brief Returns the hash of a snapshot, to use it as the key of a hash table.
+ * @param snapshot The snapshot.
+ * @return uint64_t
+ */
+uint64_t snapshot_hash(const struct snapshot *snapshot) {
+  const unsigned char *bytes = (const unsigned char *) snapshot;
+  uint64_t hash = 0;
+
+  for (size_t i = 0; i < sizeof(struct snapshot); i += sizeof(uint64_t)) {
+    uint64_t word;
+
+    memcpy(&word, bytes + i, sizeof(word));
+    hash = (hash ^ word) * UINT64_C(0x9e3779b97f4a7c15);
+    hash ^= hash >> 32;
+  }
+
+  return hash;
+}
+
+
+/**
+ * @brief Tells whether two snapshots hold the same state.
+ * @param a The first snapshot.
+ * @param b The second snapshot.
+ * @return bool
+ */
+bool snapshot_equal(const struct snapshot *a, const struct snapshot *b) {
+  return memcmp(a, b, sizeof(struct snapshot)) == 0;
+}
+
+
+/**
+ * @brief Finds the groups of every game of a batch, two games at a time when AVX2 is available.
+ * @details The cells are laid out by color, so the same color of consecutive games is contiguous in memory and a
+ * single 256-bit register holds it for two games.
+ * @param cells The cells to be checked, by color and by game.
+ * @param matches The cells to be emptied, by game.
+ * @param count Number of games.
+ */
+void find_matches_batch(bitboard cells[BLANK][BATCH_SIZE], bitboard *matches, int count) {
+  int i = 0;
+
+#if defined(__AVX2__)
+  for (; i + 1 < count; i += 2) {
+    __m256i runs = _mm256_setzero_si256();
+
+    for (int color = RED; color < BLANK; color++)
+      runs = _mm256_or_si256(runs, bb_runs256(_mm256_loadu_si256((const __m256i *) &cells[color][i]), MIN_ELEMENTS));
+
+    _mm256_storeu_si256((__m256i *) &matches[i], runs);
+  }
+#endif
+
+  for (; i < count; i++) {
+    matches[i] = bb_zero();
+
+    for (int color = RED; color < BLANK; color++)
+      matches[i] = bb_or(matches[i], bb_runs(cells[color][i], MIN_ELEMENTS));
+  }
+}
+
+
+/**
+ * The boards of a batch laid out by set, like the cells of `find_matches_batch()`: the same set of consecutive games is
+ * contiguous in memory, so a single 256-bit register holds it for two games.
+ */
+struct board_batch {
+  bitboard color[BLANK][BATCH_SIZE];
+  bitboard virus[BATCH_SIZE];
+  bitboard link[2][BATCH_SIZE];
+};
+
+
+/**
+ * @brief Copies a board into a batch.
+ * @param batch The batch.
+ * @param i Index of the board in the batch.
+ * @param board Pointer to the board.
+ */
+void set_batch_board(struct board_batch *batch, int i, const struct board *board) {
+  for (int color = RED; color < BLANK; color++)
+    batch->color[color][i] = board->color[color];
+
+  batch->virus[i] = board->virus;
+  batch->link[HORIZONTAL][i] = board->link[HORIZONTAL];
+  batch->link[VERTICAL][i] = board->link[VERTICAL];
+}
+
+
+/**
+ * @brief Copies a board out of a batch.
+ * @param batch The batch.
+ * @param i Index of the board in the batch.
+ * @param board Pointer to the board.
+ */
+void get_batch_board(const struct board_batch *batch, int i, struct board *board) {
+  for (int color = RED; color < BLANK; color++)
+    board->color[color] = batch->color[color][i];
+
+  board->virus = batch->virus[i];
+  board->link[HORIZONTAL] = batch->link[HORIZONTAL][i];
+  board->link[VERTICAL] = batch->link[VERTICAL][i];
+}
+
+
+#if defined(__AVX2__)
+/**
+ * @brief Same as `drop_fragments()`, on two consecutive boards of a batch at once, one in each 128-bit lane.
+ * @param batch The batch.
+ * @param i Index of the first board.
+ * @return __m256i The cells which have fallen, where they were before falling, for both boards.
+ */
+__m256i drop_fragments2(struct board_batch *batch, int i) {
+  __m256i colors[BLANK];
+  __m256i occupied = _mm256_setzero_si256();
+
+  for (int color = RED; color < BLANK; color++) {
+    colors[color] = _mm256_loadu_si256((const __m256i *) &batch->color[color][i]);
+    occupied = _mm256_or_si256(occupied, colors[color]);
+  }
+
+  __m256i virus = _mm256_loadu_si256((const __m256i *) &batch->virus[i]);
+  __m256i left_halves = _mm256_loadu_si256((const __m256i *) &batch->link[HORIZONTAL][i]);
+  __m256i right_halves = _mm256_slli_si256(left_halves, 2);
+  __m256i upper_halves = _mm256_loadu_si256((const __m256i *) &batch->link[VERTICAL][i]);
+  __m256i lower_halves = _mm256_slli_epi16(upper_halves, 1);
+  __m256i joined = _mm256_or_si256(_mm256_or_si256(left_halves, right_halves),
+                                   _mm256_or_si256(upper_halves, lower_halves));
+  __m256i single_halves = _mm256_andnot_si256(joined, _mm256_andnot_si256(virus, occupied));
+
+  // The cells with an empty cell below, but the last row.
+  __m256i blocked = _mm256_or_si256(_mm256_srli_epi16(occupied, 1), _mm256_set1_epi16((short) (1u << (ROWS - 1))));
+  __m256i free = _mm256_andnot_si256(blocked, _mm256_set1_epi8(-1));
+
+  __m256i falling_lower_halves = _mm256_and_si256(lower_halves, free);
+  __m256i falling_left_halves = _mm256_and_si256(_mm256_and_si256(left_halves, free),
+                                                 _mm256_srli_si256(_mm256_and_si256(right_halves, free), 2));
+  __m256i falling = _mm256_or_si256(
+      _mm256_and_si256(single_halves, free),
+      _mm256_or_si256(_mm256_or_si256(falling_lower_halves, _mm256_srli_epi16(falling_lower_halves, 1)),
+                      _mm256_or_si256(falling_left_halves, _mm256_slli_si256(falling_left_halves, 2))));
+
+  if (_mm256_testz_si256(falling, falling))
+    return falling;
+
+  for (int color = RED; color < BLANK; color++)
+    _mm256_storeu_si256((__m256i *) &batch->color[color][i], bb_fall256(colors[color], falling));
+
+  _mm256_storeu_si256((__m256i *) &batch->link[HORIZONTAL][i], bb_fall256(left_halves, falling));
+  _mm256_storeu_si256((__m256i *) &batch->link[VERTICAL][i], bb_fall256(upper_halves, falling));
+
+  return falling;
+}
+#endif
+
+
+/**
+ * @brief Shakes the grids of a batch of games at once.
+ * @details The boards are laid out by set, then every step drops the fragments of all the boards still moving, until
+ * none of them is. With AVX2 the boards are dropped two at a time, the same way `find_matches_batch()` finds their
+ * groups.
+ * @param games The games.
+ * @param indexes The games of the batch to be shaken.
+ * @param count Number of games to be shaken.
+ * @param shaken Receives, for every game, `true` if its grid changed and need to be processed again.
+ */
+void shake_batch(struct game *games, const size_t *indexes, int count, bool *shaken) {
+  struct board_batch batch;
+  bitboard moved[BATCH_SIZE];
+  bool moving[BATCH_SIZE];
+  bool any_moving = count > 0;
+
+  for (int i = 0; i < count; i++) {
+    set_batch_board(&batch, i, &games[indexes[i]].board);
+    moved[i] = bb_zero();
+    moving[i] = true;
+  }
+
+  while (any_moving) {
+    int i = 0;
+
+    any_moving = false;
+
+#if defined(__AVX2__)
+    // A board which stopped does not fall any more, so dropping it again along with the other one changes nothing.
+    for (; i + 1 < count; i += 2) {
+      if (!moving[i] && !moving[i + 1])
+        continue;
+
+      __m256i falling = drop_fragments2(&batch, i);
+      __m256i cells = _mm256_or_si256(_mm256_loadu_si256((const __m256i *) &moved[i]), falling);
+      bitboard fallen[2];
+
+      _mm256_storeu_si256((__m256i *) &moved[i], bb_fall256(cells, falling));
+      _mm256_storeu_si256((__m256i *) fallen, falling);
+
+      for (int k = 0; k < 2; k++) {
+        moving[i + k] = bb_any(fallen[k]);
+        any_moving |= moving[i + k];
+      }
+    }
+#endif
+
+    for (; i < count; i++) {
+      struct board board;
+
+      if (!moving[i])
+        continue;
+
+      get_batch_board(&batch, i, &board);
+
+      bitboard falling = drop_fragments(&board);
+
+      moving[i] = bb_any(falling);
+
+      if (!moving[i])
+        continue;
+
+      set_batch_board(&batch, i, &board);
+      moved[i] = bb_fall(bb_or(moved[i], falling), falling);
+      any_moving = true;
+    }
+  }
+
+  for (int i = 0; i < count; i++) {
+    struct board board;
+
+    get_batch_board(&batch, i, &board);
+    shaken[i] = end_shake(&games[indexes[i]], &board, &moved[i]);
+  }
+}
+
+
+/**
+ * @brief Processes the grids of a batch of games whose pill has just landed, as `process_grid()` does for one game.
+ * @details The cascades go on in lockstep: every step finds the groups of all the games still in a cascade, then
+ * empties and shakes their grids. A game leaves the batch as soon as its cascade is over.
+ * @param games The games.
+ * @param indexes The games of the batch whose pill has landed. The array is reused as a work area.
+ * @param count Number of games whose pill has landed.
+ */
+void process_batch(struct game *games, size_t *indexes, int count) {
+  bitboard cells[BLANK][BATCH_SIZE];
+  bitboard matches[BATCH_SIZE];
+  bool shaken[BATCH_SIZE];
+  size_t landed[BATCH_SIZE];
+  int landed_count = count;
+
+  for (int i = 0; i < count; i++) {
+    landed[i] = indexes[i];
+    games[indexes[i]].cascade.steps = 0;
+  }
+
+  while (count > 0) {
+    int cleared = 0;
+
+    for (int i = 0; i < count; i++) {
+      bitboard lines[BLANK];
+      struct game *game = &games[indexes[i]];
+
+      get_changed_lines(game, lines);
+      game->changed_cells = bb_zero();
+
+      for (int color = RED; color < BLANK; color++)
+        cells[color][i] = lines[color];
+    }
+
+    find_matches_batch(cells, matches, count);
+
+#ifdef DRMAURO_CHECK_MATCHES
+    for (int i = 0; i < count; i++)
+      assert(bb_equal(matches[i], find_matches(&games[indexes[i]].board)));
+#endif
+
+    for (int i = 0; i < count; i++) {
+      if (clear_matches(&games[indexes[i]], &matches[i]))
+        indexes[cleared++] = indexes[i];
+    }
+
+    shake_batch(games, indexes, cleared, shaken);
+
+    count = 0;
+
+    for (int i = 0; i < cleared; i++) {
+      if (shaken[i] && games[indexes[i]].cascade.steps < MAX_CASCADE_STEPS)
+        indexes[count++] = indexes[i];
+    }
+  }
+
+  for (int i = 0; i < landed_count; i++)
+    end_cascade(&games[landed[i]]);
+}
+
+
+/**
+ * @brief Executes one command for every game of an array, as `execute()` does for a single game.
+ * @details The games are processed in batches of `BATCH_SIZE`. Every game of a batch is moved first, then the grids of
+ * the ones whose pill has landed are processed together by `process_batch()`. The games stay independent: the result
+ * is the same as executing the commands one game at a time.
+ * @param games The games.
+ * @param commands The command for every game.
+ * @param n Number of games.
+ */
+void execute_batch(struct game *games, const enum command *commands, size_t n) {
+  size_t landed[BATCH_SIZE];
+
+  for (size_t start = 0; start < n; start += BATCH_SIZE) {
+    size_t end = n - start < BATCH_SIZE ? n : start + BATCH_SIZE;
+    int count = 0;
+
+    for (size_t i = start; i < end; i++) {
+      apply_command(&games[i], commands[i]);
+
+      if (place_pill(&games[i]))
+        landed[count++] = i;
+    }
+
+    process_batch(games, landed, count);
+
+#ifdef DRMAURO_CHECK_HASH
+    for (size_t i = start; i < end; i++)
+      assert(games[i].hash == compute_hash(&games[i]));
+#endif
+  }
+}
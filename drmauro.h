@@ -5,8 +5,16 @@
 #define COLUMNS 8
 #define INVALIDE_ROWS 5
 #define MIN_ELEMENTS 4
+#define PILL_ROW_OFFSET 4
+#define MAX_CASCADE_STEPS ((ROWS * COLUMNS) / MIN_ELEMENTS)
+#define GRID_TEXT_SIZE (2 * (COLUMNS + 1) + 5 + ROWS * (COLUMNS + 4) + 1)
 
 #include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+
+#include "bitboard.h"
+#include "rng.h"
 
 enum content { EMPTY, VIRUS, PILL };
 enum color { RED, YELLOW, BLUE, BLANK };
@@ -14,6 +22,12 @@ enum command { NONE, RIGHT, LEFT, DOWN, CLOCKWISE_ROTATION, ANTICLOCKWISE_ROTATI
 enum state { RUNNING, VICTORY, DEFEAT };
 enum rotation { CLOCKWISE, ANTICLOCKWISE };
 enum direction { HORIZONTAL, VERTICAL };
+enum link { UNLINKED, LINKED_UP, LINKED_DOWN, LINKED_LEFT, LINKED_RIGHT };
+enum log_level { LOG_NONE, LOG_ERROR, LOG_INFO, LOG_DEBUG };
+enum error {
+  NO_ERROR, CANNOT_OPEN_FILE, INVALID_CHARACTER, INVALID_DIFFICULTY, CANNOT_WRITE_FILE, INVALID_REPLAY,
+  BOARD_FILE_TOO_LARGE
+};
 
 
 struct halve {
@@ -26,19 +40,60 @@ struct pill {
     enum direction orientation;
     struct halve first_half;
     struct halve second_half;
-    int id;
     bool active;
 };
 
+/**
+ * The content of a cell. `link` tells where the other half of the same pill is, `UNLINKED` for viruses, empty cells
+ * and halves left alone.
+ */
 struct cell {
-  enum content type;
-  enum color color;
-  int id;
-  bool to_be_emptied;
+  enum content type : 4;
+  enum color color : 4;
+  enum link link : 4;
+};
+
+/**
+ * The grid, stored as sets of cells. Viruses and pill halves both belong to the mask of their color, and the virus mask
+ * tells them apart. `link[HORIZONTAL]` holds the halves joined to the cell on their right, `link[VERTICAL]` the halves
+ * joined to the cell below.
+ */
+struct board {
+  bitboard color[BLANK];
+  bitboard virus;
+  bitboard link[2];
 };
 
+/**
+ * Statistics of the last cascade, which starts when a pill lands: for every step, the number of cells emptied and the
+ * points scored.
+ */
+struct cascade {
+  int steps;
+  int cleared[MAX_CASCADE_STEPS];
+  int score[MAX_CASCADE_STEPS];
+};
+
+/**
+ * Receives the messages of a game, which are only sent when their level is at least as important as the one of the
+ * logger. `LOG_DEBUG` includes a dump of the grid at every step of a cascade.
+ */
+typedef void (*log_sink)(void *context, enum log_level level, const char *message);
+
+struct logger {
+  enum log_level level;
+  log_sink sink;
+  void *context;
+};
+
+/**
+ * A game. `hash` is the Zobrist hash of the board and of the active pill, updated at every change of either: see
+ * `game_hash()`.
+ */
 struct game {
-  struct cell grid[ROWS][COLUMNS];
+  struct board board;
+  bitboard changed_cells;
+  uint64_t hash;
   struct pill pill;
   struct pill moving_pill;
   int pills_count;
@@ -46,15 +101,68 @@ struct game {
   enum state status;
   int score;
   int points_multiplier;
+  struct cascade cascade;
+  struct rng rng;
+  struct logger logger;
+};
+
+/**
+ * The state of a game between two ticks, packed in 104 bytes for the bots which clone it many times. The cells are two
+ * bit planes of their color, `RED` + 1 to `BLUE` + 1, and two bit planes of their kind: virus, linked to the right,
+ * linked below, or anything else. The pill, the state and the count of viruses are packed in `pill`. The hash of the
+ * game is kept too, so that it's not computed again on restore.
+ * The copy is canonical, so that equal states give equal bytes and snapshots can be compared and hashed as keys: what
+ * a game only uses within a tick, like the moving pill and the cascade statistics, is left out, and so is an inactive
+ * pill.
+ */
+struct snapshot {
+  bitboard color_bits[2];
+  bitboard kind_bits[2];
+  struct rng rng;
+  int32_t score;
+  int32_t pills_count;
+  int32_t points_multiplier;
+  uint32_t pill;
+  uint64_t hash;
 };
 
+_Static_assert(sizeof(struct snapshot) == 104, "the snapshot must have no padding");
+
 
+struct cell get_cell(const struct game *game, int row, int column);
+int get_landing_row(const struct game *game, int row, int column);
+int get_column_height(const struct game *game, int column);
+const char *get_error_message(enum error error);
+void format_grid(const struct game *game, char *text);
 void print_grid(struct game *game);
+void set_logger(struct game *game, enum log_level level, log_sink sink, void *context);
+void log_to_stream(void *context, enum log_level level, const char *message);
+void init_game(struct game *game, uint64_t seed);
 void init_grid(struct game *game);
-void load_grid(struct game *game, char *path);
-void fill_grid(struct game *game, int difficulty);
+enum error load_grid(struct game *game, const char *path);
+enum error read_grid(struct game *game, FILE *fp, const char *name);
+enum error fill_grid(struct game *game, int difficulty);
 void refresh_grid(struct game *game);
 void execute(struct game *game, enum command command);
+void execute_batch(struct game *games, const enum command *commands, size_t n);
 enum state victory(struct game *game);
+uint64_t get_next_pill_hash(const struct game *game, bool colors_swapped);
+uint64_t game_hash(const struct game *game);
+uint64_t compute_hash(const struct game *game);
+void game_snapshot(const struct game *game, struct snapshot *snapshot);
+void game_restore(struct game *game, const struct snapshot *snapshot);
+uint64_t snapshot_hash(const struct snapshot *snapshot);
+bool snapshot_equal(const struct snapshot *a, const struct snapshot *b);
+
+// Steps of `execute()`, exposed for the benchmarks.
+void set_cell(struct game *game, int row, int column, enum content type, enum color color);
+void apply_command(struct game *game, enum command command);
+void rotate_pill(struct game *game, enum rotation direction);
+void move_pill(struct game *game, enum command direction);
+bool place_pill(struct game *game);
+void process_grid(struct game *game);
+bitboard find_changed_matches(struct game *game);
+bool empty_cells(struct game *game, const bitboard *to_be_emptied);
+bool shake_grid(struct game *game);
 
 #endif
@@ -0,0 +1,646 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <getopt.h>
+
+#include "drmauro.h"
+#include "placement.h"
+#include "bot.h"
+
+#ifndef DRMAURO_DATA_DIR
+#define DRMAURO_DATA_DIR "."
+#endif
+
+#define MAX_REPETITIONS 100
+#define MAX_POSITIONS 64
+#define MIN_CASCADE_STEPS 3
+#define BATCH_GAMES 256
+
+
+/******************************************************************************/
+/* HARNESS                                                                    */
+
+enum format { CSV, JSON };
+
+struct options {
+  int warmup;
+  int repetitions;
+  double min_time;
+  const char *filter;
+  enum format format;
+  const char *data_dir;
+};
+
+/**
+ * Runs an operation of a benchmark `iterations` times in a row.
+ */
+typedef void (*operation)(void *fixture, long long iterations);
+
+// The operations add their results here, so that the compiler cannot drop them.
+volatile long long sink;
+
+// Number of results written so far, to separate the JSON objects.
+int results_count;
+
+
+/**
+ * @brief Returns the time elapsed from an arbitrary point, in seconds.
+ * @return double
+ */
+double get_time() {
+  struct timespec now;
+
+  clock_gettime(CLOCK_MONOTONIC, &now);
+
+  return now.tv_sec + now.tv_nsec / 1e9;
+}
+
+
+/**
+ * @brief Returns the time taken by `iterations` runs of the operation, in seconds.
+ */
+double measure(operation run, void *fixture, long long iterations) {
+  double start = get_time();
+
+  run(fixture, iterations);
+
+  return get_time() - start;
+}
+
+
+int compare_doubles(const void *a, const void *b) {
+  double x = *(const double *) a, y = *(const double *) b;
+
+  return (x > y) - (x < y);
+}
+
+
+/**
+ * @brief Returns the name of the SIMD instructions the engine has been built with.
+ * @return const char*
+ */
+const char *get_simd() {
+#if defined(__AVX2__)
+  return "avx2";
+#elif defined(__SSE2__)
+  return "sse2";
+#else
+  return "scalar";
+#endif
+}
+
+
+/**
+ * @brief Writes the header of the output.
+ * @param options The options of the run.
+ */
+void begin_output(const struct options *options) {
+  if (options->format == CSV)
+    printf("benchmark,parameter,iterations,repetitions,ns_min,ns_median,ns_mean,ops_per_second\n");
+  else
+    printf("{\n  \"simd\": \"%s\",\n  \"warmup\": %d,\n  \"repetitions\": %d,\n  \"benchmarks\": [", get_simd(),
+           options->warmup, options->repetitions);
+}
+
+
+/**
+ * @brief Writes the end of the output.
+ * @param options The options of the run.
+ */
+void end_output(const struct options *options) {
+  if (options->format == JSON)
+    printf("\n  ]\n}\n");
+}
+
+
+/**
+ * @brief Measures an operation and writes its statistics.
+ * @details The number of iterations is doubled until a repetition lasts at least `min_time` seconds. Then the
+ * operation is run for `warmup` repetitions, which are discarded, and for `repetitions` ones, which are measured.
+ * The times are given in nanoseconds per operation.
+ * @param options The options of the run.
+ * @param name Name of the benchmark.
+ * @param parameter Parameter of the benchmark, such as the difficulty or the file.
+ * @param run The operation.
+ * @param fixture The data of the operation.
+ */
+void run_benchmark(const struct options *options, const char *name, const char *parameter, operation run,
+                   void *fixture) {
+  double samples[MAX_REPETITIONS];
+  long long iterations = 1;
+  double mean = 0;
+
+  if (options->filter && !strstr(name, options->filter))
+    return;
+
+  while (measure(run, fixture, iterations) < options->min_time && iterations < (1LL << 40))
+    iterations *= 2;
+
+  for (int i = 0; i < options->warmup; i++)
+    measure(run, fixture, iterations);
+
+  for (int i = 0; i < options->repetitions; i++) {
+    samples[i] = measure(run, fixture, iterations) * 1e9 / (double) iterations;
+    mean += samples[i] / options->repetitions;
+  }
+
+  qsort(samples, (size_t) options->repetitions, sizeof(double), compare_doubles);
+
+  double min = samples[0], median = samples[options->repetitions / 2];
+
+  if (options->format == CSV)
+    printf("%s,%s,%lld,%d,%.2f,%.2f,%.2f,%.0f\n", name, parameter, iterations, options->repetitions, min, median, mean,
+           1e9 / median);
+  else
+    printf("%s\n    { \"benchmark\": \"%s\", \"parameter\": \"%s\", \"iterations\": %lld, \"repetitions\": %d, "
+           "\"ns_min\": %.2f, \"ns_median\": %.2f, \"ns_mean\": %.2f, \"ops_per_second\": %.0f }",
+           results_count ? "," : "", name, parameter, iterations, options->repetitions, min, median, mean,
+           1e9 / median);
+
+  results_count++;
+  fflush(stdout);
+}
+
+
+/******************************************************************************/
+/* FIXTURES                                                                   */
+
+/**
+ * A game and what an operation needs to replay it. Every operation starts from the same seed, so two runs of the
+ * benchmark do the same work.
+ */
+struct fixture {
+  struct game game;
+  int difficulty;
+  const char *path;
+  uint64_t seed;
+  struct rng commands;
+  struct game *positions;
+  int positions_count;
+  struct snapshot snapshots[MAX_POSITIONS];
+  struct placements placements;
+  struct bot bot;
+  struct bot_workspace workspace;
+};
+
+
+/**
+ * @brief Generates a new grid for every iteration.
+ */
+void run_fill_grid(void *data, long long iterations) {
+  struct fixture *fixture = data;
+
+  for (long long i = 0; i < iterations; i++) {
+    init_game(&fixture->game, fixture->seed++);
+    fill_grid(&fixture->game, fixture->difficulty);
+    sink += fixture->game.virus_count;
+  }
+}
+
+
+/**
+ * @brief Loads the same file for every iteration.
+ */
+void run_load_grid(void *data, long long iterations) {
+  struct fixture *fixture = data;
+
+  for (long long i = 0; i < iterations; i++) {
+    init_game(&fixture->game, 1);
+    sink += load_grid(&fixture->game, fixture->path);
+  }
+}
+
+
+/**
+ * @brief Processes the grid of one of the positions for every iteration, after restoring it.
+ */
+void run_process_grid(void *data, long long iterations) {
+  struct fixture *fixture = data;
+
+  for (long long i = 0; i < iterations; i++) {
+    fixture->game = fixture->positions[i % fixture->positions_count];
+    process_grid(&fixture->game);
+    sink += fixture->game.score;
+  }
+}
+
+
+/**
+ * @brief Shakes the grid of one of the positions for every iteration, after restoring it.
+ */
+void run_shake_grid(void *data, long long iterations) {
+  struct fixture *fixture = data;
+
+  for (long long i = 0; i < iterations; i++) {
+    fixture->game = fixture->positions[i % fixture->positions_count];
+    sink += shake_grid(&fixture->game);
+  }
+}
+
+
+/**
+ * @brief Copies one of the positions for every iteration, as a whole structure.
+ */
+void run_copy_game(void *data, long long iterations) {
+  struct fixture *fixture = data;
+
+  for (long long i = 0; i < iterations; i++) {
+    fixture->game = fixture->positions[i % fixture->positions_count];
+    sink += fixture->game.score;
+  }
+}
+
+
+/**
+ * @brief Takes a snapshot of one of the positions for every iteration.
+ */
+void run_game_snapshot(void *data, long long iterations) {
+  struct fixture *fixture = data;
+
+  for (long long i = 0; i < iterations; i++) {
+    int j = (int) (i % fixture->positions_count);
+
+    game_snapshot(&fixture->positions[j], &fixture->snapshots[j]);
+    sink += fixture->snapshots[j].score;
+  }
+}
+
+
+/**
+ * @brief Restores one of the snapshots for every iteration.
+ */
+void run_game_restore(void *data, long long iterations) {
+  struct fixture *fixture = data;
+
+  for (long long i = 0; i < iterations; i++) {
+    game_restore(&fixture->game, &fixture->snapshots[i % fixture->positions_count]);
+    sink += fixture->game.score;
+  }
+}
+
+
+/**
+ * @brief Rotates the pill for every iteration, alternating the direction.
+ */
+void run_rotate_pill(void *data, long long iterations) {
+  struct fixture *fixture = data;
+
+  for (long long i = 0; i < iterations; i++) {
+    rotate_pill(&fixture->game, (i & 1) ? CLOCKWISE : ANTICLOCKWISE);
+    sink += fixture->game.moving_pill.first_half.column;
+  }
+}
+
+
+/**
+ * @brief Moves the pill for every iteration, cycling through the directions.
+ */
+void run_move_pill(void *data, long long iterations) {
+  static const enum command directions[] = { LEFT, RIGHT, DOWN, NONE };
+  struct fixture *fixture = data;
+
+  for (long long i = 0; i < iterations; i++) {
+    move_pill(&fixture->game, directions[i & 3]);
+    sink += fixture->game.moving_pill.first_half.row;
+  }
+}
+
+
+/**
+ * @brief Finds the placements of the pill of one of the positions for every iteration.
+ */
+void run_find_placements(void *data, long long iterations) {
+  struct fixture *fixture = data;
+
+  for (long long i = 0; i < iterations; i++)
+    sink += find_placements(&fixture->positions[i % fixture->positions_count], &fixture->placements);
+}
+
+
+/**
+ * @brief Drops the pill of one of the positions for every iteration, after restoring it, with a single placement.
+ */
+void run_execute_placement(void *data, long long iterations) {
+  struct fixture *fixture = data;
+
+  for (long long i = 0; i < iterations; i++) {
+    fixture->game = fixture->positions[i % fixture->positions_count];
+    sink += execute_placement(&fixture->game, fixture->game.pill.first_half.column, HORIZONTAL, false);
+  }
+}
+
+
+/**
+ * @brief Computes the hash of one of the positions shared with its mirror for every iteration.
+ */
+void run_canonical_hash(void *data, long long iterations) {
+  struct fixture *fixture = data;
+
+  for (long long i = 0; i < iterations; i++)
+    sink += get_canonical_hash(&fixture->positions[i % fixture->positions_count], NULL);
+}
+
+
+/**
+ * @brief Chooses where to land the pill of one of the positions for every iteration.
+ */
+void run_bot_choose(void *data, long long iterations) {
+  struct fixture *fixture = data;
+
+  for (long long i = 0; i < iterations; i++)
+    sink += bot_choose(&fixture->bot, &fixture->workspace, &fixture->positions[i % fixture->positions_count],
+                       &fixture->placements, NULL);
+}
+
+
+/**
+ * @brief Executes a random command for every iteration. A new game is started when the current one is over.
+ */
+void run_execute(void *data, long long iterations) {
+  struct fixture *fixture = data;
+
+  for (long long i = 0; i < iterations; i++) {
+    if (victory(&fixture->game) != RUNNING) {
+      init_game(&fixture->game, fixture->seed++);
+      fill_grid(&fixture->game, fixture->difficulty);
+    }
+
+    execute(&fixture->game, (enum command) rng_below(&fixture->commands, ANTICLOCKWISE_ROTATION + 1));
+  }
+
+  sink += fixture->game.score;
+}
+
+
+/**
+ * @brief Executes a random command for `BATCH_GAMES` games at once. Every iteration is a tick of a single game.
+ */
+void run_execute_batch(void *data, long long iterations) {
+  struct fixture *fixture = data;
+  struct game *games = fixture->positions;
+  enum command commands[BATCH_GAMES];
+
+  for (long long i = 0; i < iterations; i += BATCH_GAMES) {
+    for (int j = 0; j < BATCH_GAMES; j++) {
+      if (victory(&games[j]) != RUNNING) {
+        init_game(&games[j], fixture->seed++);
+        fill_grid(&games[j], fixture->difficulty);
+      }
+
+      commands[j] = (enum command) rng_below(&fixture->commands, ANTICLOCKWISE_ROTATION + 1);
+    }
+
+    execute_batch(games, commands, BATCH_GAMES);
+  }
+
+  sink += games[0].score;
+}
+
+
+/**
+ * @brief Fills the positions with grids whose cascade lasts at least `MIN_CASCADE_STEPS` steps.
+ * @details Every cell below the first valid rows holds a virus or a single half of random color, so the grid is full
+ * of groups. Grids are drawn until enough of them give a long cascade. The positions are ready for `process_grid()`.
+ * @param positions The positions.
+ * @return double The average number of steps of the cascades.
+ */
+double make_cascades(struct game *positions) {
+  struct rng rng;
+  int steps = 0;
+
+  rng_seed(&rng, 1);
+
+  for (int count = 0; count < MAX_POSITIONS; ) {
+    struct game *game = &positions[count];
+    struct game cascade;
+
+    init_game(game, count);
+
+    for (int row = INVALIDE_ROWS; row < ROWS; row++)
+      for (int column = 0; column < COLUMNS; column++) {
+        enum content type = (row >= ROWS / 2 && rng_below(&rng, 2)) ? VIRUS : PILL;
+
+        set_cell(game, row, column, type, (enum color) rng_below(&rng, BLANK));
+        game->virus_count += type == VIRUS;
+      }
+
+    game->changed_cells = bb_full();
+
+    cascade = *game;
+    process_grid(&cascade);
+
+    if (cascade.cascade.steps >= MIN_CASCADE_STEPS) {
+      steps += cascade.cascade.steps;
+      count++;
+    }
+  }
+
+  return (double) steps / MAX_POSITIONS;
+}
+
+
+/**
+ * @brief Turns the positions ready for `process_grid()` into positions ready for `shake_grid()`, emptying the first
+ * groups of their cascade.
+ * @param positions The positions.
+ */
+void make_shakes(struct game *positions) {
+  for (int i = 0; i < MAX_POSITIONS; i++) {
+    bitboard matches = find_changed_matches(&positions[i]);
+
+    empty_cells(&positions[i], &matches);
+  }
+}
+
+
+/******************************************************************************/
+/* MAIN                                                                       */
+
+/**
+ * @brief Plays a few pills of every game, landing each one on a random placement, and stops when a new pill appears.
+ * @return double The average number of placements of the last pills.
+ */
+double make_pills(struct game *positions) {
+  static struct placements placements;
+  enum command commands[PILL_STATES];
+  struct rng choices;
+  int count = 0;
+
+  rng_seed(&choices, 2);
+
+  for (int i = 0; i < MAX_POSITIONS; i++) {
+    struct game *game = &positions[i];
+    int pills = (int) rng_below(&choices, 20) + 1;
+
+    init_game(game, (uint64_t) i + 1);
+    fill_grid(game, 10);
+    execute(game, NONE);
+
+    while (game->status == RUNNING && game->pills_count < pills && find_placements(game, &placements) > 0) {
+      int n = get_placement_commands(&placements, (int) rng_below(&choices, (uint32_t) placements.count), commands);
+
+      for (int j = 0; j < n; j++)
+        execute(game, commands[j]);
+
+      execute(game, NONE);
+    }
+
+    count += find_placements(game, &placements);
+  }
+
+  return (double) count / MAX_POSITIONS;
+}
+
+
+void usage() {
+  fprintf(stderr, "DR.MAURO - benchmarks of the rules engine\n"
+          "Usage: drmauro_bench [-w WARMUP] [-r REPETITIONS] [-t SECONDS] [-b BENCHMARK] [-j] [-D DIR] [-h]\n"
+          "\n"
+          "OPTIONS:\n"
+          "  -w WARMUP       Repetitions run before measuring (default 2)\n"
+          "  -r REPETITIONS  Repetitions measured (default 10)\n"
+          "  -t SECONDS      Minimum time of a repetition (default 0.02)\n"
+          "  -b BENCHMARK    Run only the benchmarks whose name contains BENCHMARK\n"
+          "  -j              Write JSON instead of CSV\n"
+          "  -D DIR          Directory of the campo*.txt files (default the source directory)\n"
+          "  -h              Show this help message\n"
+          );
+  exit(1);
+}
+
+
+int main(int argc, char **argv) {
+  static const char *files[] = { "campo.txt", "campo2.txt", "campo3.txt" };
+  struct options options = { 2, 10, 0.02, NULL, CSV, DRMAURO_DATA_DIR };
+  struct fixture fixture;
+  struct game *positions = malloc(sizeof(struct game) * (BATCH_GAMES > MAX_POSITIONS ? BATCH_GAMES : MAX_POSITIONS));
+  char parameter[512];
+  enum error error;
+  int c;
+
+  while ((c = getopt(argc, argv, "w:r:t:b:jD:h")) != -1) {
+    switch (c) {
+      case 'w': options.warmup = atoi(optarg); break;
+      case 'r': options.repetitions = atoi(optarg); break;
+      case 't': options.min_time = atof(optarg); break;
+      case 'b': options.filter = optarg; break;
+      case 'j': options.format = JSON; break;
+      case 'D': options.data_dir = optarg; break;
+      default: usage();
+    }
+  }
+
+  if (optind < argc || options.warmup < 0 || options.repetitions <= 0 || options.repetitions > MAX_REPETITIONS)
+    usage();
+
+  if (!positions) {
+    fprintf(stderr, "Out of memory.\n");
+    return EXIT_FAILURE;
+  }
+
+  begin_output(&options);
+
+  for (int difficulty = 0; difficulty <= 15; difficulty++) {
+    memset(&fixture, 0, sizeof(fixture));
+    fixture.difficulty = difficulty;
+    fixture.seed = 1;
+    sprintf(parameter, "difficulty=%d", difficulty);
+    run_benchmark(&options, "fill_grid", parameter, run_fill_grid, &fixture);
+  }
+
+  for (int i = 0; i < (int) (sizeof(files) / sizeof(files[0])); i++) {
+    memset(&fixture, 0, sizeof(fixture));
+    snprintf(parameter, sizeof(parameter), "%s/%s", options.data_dir, files[i]);
+    fixture.path = parameter;
+
+    init_game(&fixture.game, 1);
+    error = load_grid(&fixture.game, fixture.path);
+
+    if (error != NO_ERROR) {
+      fprintf(stderr, "%s: %s\n", fixture.path, get_error_message(error));
+      continue;
+    }
+
+    run_benchmark(&options, "load_grid", files[i], run_load_grid, &fixture);
+  }
+
+  memset(&fixture, 0, sizeof(fixture));
+  fixture.positions = positions;
+  fixture.positions_count = MAX_POSITIONS;
+  sprintf(parameter, "steps=%.2f", make_cascades(positions));
+  run_benchmark(&options, "process_grid", parameter, run_process_grid, &fixture);
+
+  make_shakes(positions);
+  run_benchmark(&options, "shake_grid", "cascade", run_shake_grid, &fixture);
+
+  // The snapshots are taken once here too, in case the benchmark of `game_snapshot()` is filtered out.
+  for (int i = 0; i < MAX_POSITIONS; i++)
+    game_snapshot(&positions[i], &fixture.snapshots[i]);
+
+  sprintf(parameter, "bytes=%zu", sizeof(struct game));
+  run_benchmark(&options, "copy_game", parameter, run_copy_game, &fixture);
+  sprintf(parameter, "bytes=%zu", sizeof(struct snapshot));
+  run_benchmark(&options, "game_snapshot", parameter, run_game_snapshot, &fixture);
+  run_benchmark(&options, "game_restore", parameter, run_game_restore, &fixture);
+
+  sprintf(parameter, "placements=%.1f", make_pills(positions));
+  run_benchmark(&options, "find_placements", parameter, run_find_placements, &fixture);
+  run_benchmark(&options, "execute_placement", "drop", run_execute_placement, &fixture);
+  run_benchmark(&options, "canonical_hash", "mirror", run_canonical_hash, &fixture);
+
+  init_bot(&fixture.bot);
+  init_bot_workspace(&fixture.workspace);
+
+  for (int depth = 1; depth <= 2; depth++) {
+    fixture.bot.depth = depth;
+    sprintf(parameter, "depth=%d width=%d", depth, fixture.bot.width);
+    run_benchmark(&options, "bot_choose", parameter, run_bot_choose, &fixture);
+  }
+
+  free_bot_workspace(&fixture.workspace);
+
+  // The pill is brought a few rows down, so that it can move in every direction.
+  memset(&fixture, 0, sizeof(fixture));
+  init_game(&fixture.game, 1);
+  fill_grid(&fixture.game, 5);
+
+  for (int i = 0; i < 3; i++)
+    execute(&fixture.game, NONE);
+
+  run_benchmark(&options, "rotate_pill", "horizontal", run_rotate_pill, &fixture);
+  run_benchmark(&options, "move_pill", "horizontal", run_move_pill, &fixture);
+
+  execute(&fixture.game, CLOCKWISE_ROTATION);
+
+  run_benchmark(&options, "rotate_pill", "vertical", run_rotate_pill, &fixture);
+  run_benchmark(&options, "move_pill", "vertical", run_move_pill, &fixture);
+
+  memset(&fixture, 0, sizeof(fixture));
+  fixture.difficulty = 5;
+  fixture.seed = 1;
+  init_game(&fixture.game, 0);
+  fixture.game.status = DEFEAT;
+  rng_seed(&fixture.commands, 0);
+  rng_jump(&fixture.commands);
+  run_benchmark(&options, "execute", "difficulty=5", run_execute, &fixture);
+
+  fixture.seed = 1;
+  fixture.positions = positions;
+
+  for (int i = 0; i < BATCH_GAMES; i++) {
+    init_game(&positions[i], 0);
+    positions[i].status = DEFEAT;
+  }
+
+  sprintf(parameter, "difficulty=5 games=%d", BATCH_GAMES);
+  run_benchmark(&options, "execute_batch", parameter, run_execute_batch, &fixture);
+
+  end_output(&options);
+
+  free(positions);
+
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,464 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <getopt.h>
+
+#include "drmauro.h"
+#include "drmauro_ref.h"
+#include "placement.h"
+#include "bot.h"
+
+
+/**
+ * The state of a game both engines must agree on, after every tick.
+ */
+struct tick_state {
+  struct cell cells[ROWS][COLUMNS];
+  struct pill pill;
+  int pills_count;
+  int virus_count;
+  enum state status;
+  int score;
+  int points_multiplier;
+};
+
+
+/**
+ * The player driving both engines. Every new pill is aimed at a random column, with a few random rotations, then it's
+ * dropped or left falling. Now and then a command is drawn at random, so the odd moves are covered too.
+ */
+struct player {
+  struct rng rng;
+  int pills_count;
+  int target;
+  int rotations;
+};
+
+
+/**
+ * @brief Fills the state of the optimized engine.
+ * @param state The state.
+ * @param game Pointer to the game instance.
+ */
+void get_state(struct tick_state *state, const struct game *game) {
+  memset(state, 0, sizeof(struct tick_state));
+
+  for (int i = 0; i < ROWS; i++)
+    for (int j = 0; j < COLUMNS; j++)
+      state->cells[i][j] = get_cell(game, i, j);
+
+  state->pill = game->pill;
+  state->pills_count = game->pills_count;
+  state->virus_count = game->virus_count;
+  state->status = game->status;
+  state->score = game->score;
+  state->points_multiplier = game->points_multiplier;
+}
+
+
+/**
+ * @brief Fills the state of the reference engine.
+ * @param state The state.
+ * @param game Pointer to the game instance.
+ */
+void get_ref_state(struct tick_state *state, const struct ref_game *game) {
+  memset(state, 0, sizeof(struct tick_state));
+
+  for (int i = 0; i < ROWS; i++)
+    for (int j = 0; j < COLUMNS; j++)
+      state->cells[i][j] = ref_get_cell(game, i, j);
+
+  state->pill = game->pill;
+  state->pills_count = game->pills_count;
+  state->virus_count = game->virus_count;
+  state->status = game->status;
+  state->score = game->score;
+  state->points_multiplier = game->points_multiplier;
+}
+
+
+/**
+ * @brief Returns the FNV-1a hash of a state.
+ * @param state The state.
+ * @return uint64_t
+ */
+uint64_t hash_state(const struct tick_state *state) {
+  uint64_t hash = UINT64_C(0xcbf29ce484222325);
+
+  for (int i = 0; i < ROWS; i++)
+    for (int j = 0; j < COLUMNS; j++) {
+      const struct cell *cell = &state->cells[i][j];
+      int values[] = { cell->type, cell->color, cell->link };
+
+      for (int k = 0; k < 3; k++)
+        hash = (hash ^ (uint64_t) values[k]) * UINT64_C(0x100000001b3);
+    }
+
+  const struct pill *pill = &state->pill;
+  int values[] = {
+    pill->orientation, pill->active,
+    pill->first_half.row, pill->first_half.column, pill->first_half.color,
+    pill->second_half.row, pill->second_half.column, pill->second_half.color,
+    state->pills_count, state->virus_count, state->status, state->score, state->points_multiplier
+  };
+
+  for (size_t k = 0; k < sizeof(values) / sizeof(values[0]); k++)
+    hash = (hash ^ (uint64_t) (uint32_t) values[k]) * UINT64_C(0x100000001b3);
+
+  return hash;
+}
+
+
+/**
+ * @brief Returns the next command of the player.
+ * @param player The player.
+ * @param game Pointer to the game instance, the optimized one.
+ * @return command
+ */
+enum command next_command(struct player *player, const struct game *game) {
+  if (game->pills_count != player->pills_count) {
+    player->pills_count = game->pills_count;
+    player->target = (int) rng_below(&player->rng, COLUMNS);
+    player->rotations = (int) rng_below(&player->rng, 4);
+  }
+
+  if (rng_below(&player->rng, 16) == 0)
+    return (enum command) rng_below(&player->rng, ANTICLOCKWISE_ROTATION + 1);
+
+  // The pill rotates and moves only once it's inside the grid.
+  if (game->pill.active && game->pill.first_half.row > 0) {
+    if (player->rotations > 0) {
+      player->rotations--;
+      return rng_below(&player->rng, 2) ? CLOCKWISE_ROTATION : ANTICLOCKWISE_ROTATION;
+    }
+
+    if (game->pill.first_half.column < player->target)
+      return RIGHT;
+
+    if (game->pill.first_half.column > player->target)
+      return LEFT;
+  }
+
+  return rng_below(&player->rng, 4) ? NONE : DOWN;
+}
+
+
+/**
+ * @brief Prints two grids side by side, such as the ones of the optimized engine and of the reference one.
+ * @param a The state on the left.
+ * @param b The state on the right.
+ * @param a_name The name of the state on the left.
+ * @param b_name The name of the state on the right.
+ */
+void print_states(const struct tick_state *a, const struct tick_state *b, const char *a_name, const char *b_name) {
+  static const char links[] = " ^v<>";
+
+  for (int i = 0; i < ROWS; i++) {
+    const struct tick_state *states[] = { a, b };
+
+    printf("%2d  ", i);
+
+    for (int s = 0; s < 2; s++) {
+      for (int j = 0; j < COLUMNS; j++) {
+        const struct cell *cell = &states[s]->cells[i][j];
+        char letter = cell->type == EMPTY ? '.' : "RYB?"[cell->color];
+
+        printf("%c%c", cell->type == VIRUS ? letter + ('a' - 'A') : letter, links[cell->link]);
+      }
+
+      if (s == 0)
+        printf("   ");
+      else if (i == 0)
+        printf("   %s / %s\n", a_name, b_name);
+      else
+        printf("\n");
+    }
+  }
+
+  for (int s = 0; s < 2; s++) {
+    const struct tick_state *state = s == 0 ? a : b;
+    const struct pill *p = &state->pill;
+
+    printf("%s: pill (%d,%d)/(%d,%d) %s %s, pills %d, viruses %d, status %d, score %d, multiplier %d\n",
+           s == 0 ? a_name : b_name, p->first_half.row, p->first_half.column, p->second_half.row,
+           p->second_half.column, p->orientation == HORIZONTAL ? "horizontal" : "vertical",
+           p->active ? "active" : "inactive", state->pills_count, state->virus_count, state->status, state->score,
+           state->points_multiplier);
+  }
+}
+
+
+/**
+ * @brief Plays the same game on both engines, comparing the hash of their state after every tick.
+ * @param seed Seed of the game and of the player.
+ * @param max_ticks Ticks after which the game is left unfinished.
+ * @param ticks Incremented by the number of ticks played.
+ * @return bool Returns `false` at the first divergence, after printing it.
+ */
+bool compare_game(uint64_t seed, int max_ticks, long long *ticks) {
+  struct game game;
+  struct ref_game ref_game;
+  struct tick_state state, ref_state;
+  struct player player = { 0 };
+  int difficulty = (int) (seed % 16);
+
+  init_game(&game, seed);
+  fill_grid(&game, difficulty);
+  ref_init_game(&ref_game, seed);
+  ref_fill_grid(&ref_game, difficulty);
+
+  player.rng = game.rng;
+  rng_jump(&player.rng);
+
+  for (int tick = -1; tick < max_ticks; tick++) {
+    enum command command = NONE;
+
+    // The tick `-1` only compares the grids just filled.
+    if (tick >= 0) {
+      command = next_command(&player, &game);
+      execute(&game, command);
+      ref_execute(&ref_game, command);
+      (*ticks)++;
+    }
+
+    get_state(&state, &game);
+    get_ref_state(&ref_state, &ref_game);
+
+    if (hash_state(&state) != hash_state(&ref_state)) {
+      printf("seed %llu (difficulty %d) diverges at tick %d, after command %d\n", (unsigned long long) seed,
+             difficulty, tick, command);
+      print_states(&state, &ref_state, "optimized", "reference");
+      return false;
+    }
+
+    if (game.status != RUNNING)
+      break;
+  }
+
+  return true;
+}
+
+
+/**
+ * @brief Returns the index of a placement in a list, matching the place and the colors but not the ticks, or `-1`.
+ * @param placements The list.
+ * @param placement The placement.
+ * @return int
+ */
+int find_same_placement(const struct placements *placements, const struct placement *placement) {
+  for (int i = 0; i < placements->count; i++) {
+    const struct placement *other = &placements->placement[i];
+
+    if (other->row == placement->row && other->column == placement->column &&
+        other->orientation == placement->orientation && other->colors_swapped == placement->colors_swapped)
+      return i;
+  }
+
+  return -1;
+}
+
+
+/**
+ * @brief Checks the left-right mirror of a game with an active pill, which must be the same game reflected whenever
+ * `is_mirror_symmetric()` holds: the mirror of the mirror is the game, every placement lands on the reflection of the
+ * same grid with the same score and value, and the canonical hash of the two is the same only if the next pill is the
+ * same in the mirrored world, that is when its two colors are.
+ * @param game Pointer to the game instance.
+ * @param symmetric Incremented if the game and its mirror are symmetric.
+ * @param landings Incremented by the number of placements landed on both.
+ * @return const char * The first property which fails, or `NULL`.
+ */
+const char *check_mirror_position(const struct game *game, long long *symmetric, long long *landings) {
+  static struct placements placements, mirror_placements;
+  struct game mirror, mirror_mirror;
+  struct snapshot snapshot, mirror_snapshot;
+  struct rng rng = game->rng;
+  bool same_next_colors = rng_below(&rng, BLANK) == rng_below(&rng, BLANK);
+
+  mirror_game(game, &mirror);
+  mirror_game(&mirror, &mirror_mirror);
+  game_snapshot(game, &snapshot);
+  game_snapshot(&mirror_mirror, &mirror_snapshot);
+
+  if (!snapshot_equal(&snapshot, &mirror_snapshot))
+    return "the mirror of the mirror is not the game";
+
+  bool is_symmetric = is_mirror_symmetric(game, &mirror);
+
+  if (is_symmetric != is_mirror_symmetric(&mirror, game))
+    return "the symmetry does not hold both ways";
+
+  game_snapshot(&mirror, &mirror_snapshot);
+
+  // A game which is its own mirror has one hash anyway.
+  if (is_symmetric && !snapshot_equal(&snapshot, &mirror_snapshot) &&
+      (get_canonical_hash(game, NULL) == get_canonical_hash(&mirror, NULL)) != same_next_colors)
+    return same_next_colors ? "symmetric games have different canonical hashes" :
+                              "the canonical hash merges games with a different next pill";
+
+  int count = find_placements(game, &placements);
+  int mirror_count = find_placements(&mirror, &mirror_placements);
+
+  // The placements of a pill with both halves of the same color are not told apart by color order.
+  if (is_symmetric) {
+    (*symmetric)++;
+
+    if (count != mirror_count && game->pill.first_half.color != game->pill.second_half.color)
+      return "symmetric games have a different number of placements";
+  }
+
+  for (int i = 0; i < count; i++) {
+    struct placement placement = placements.placement[i];
+
+    mirror_placement(game, &placement);
+
+    int j = find_same_placement(&mirror_placements, &placement);
+
+    if (j < 0) {
+      if (is_symmetric)
+        return "a placement is missing in the symmetric mirror";
+      continue;
+    }
+
+    struct placement back = placement;
+
+    mirror_placement(&mirror, &back);
+
+    if (back.column != placements.placement[i].column ||
+        back.colors_swapped != placements.placement[i].colors_swapped)
+      return "the mirror of the mirror of a placement is not the placement";
+
+    struct game landed = *game, mirror_landed = mirror, reflected;
+
+    land_placement(&landed, &placements.placement[i]);
+    land_placement(&mirror_landed, &mirror_placements.placement[j]);
+    mirror_game(&mirror_landed, &reflected);
+    (*landings)++;
+
+    if (memcmp(&landed.board, &reflected.board, sizeof(struct board)) || landed.score != mirror_landed.score ||
+        landed.status != mirror_landed.status || landed.virus_count != mirror_landed.virus_count)
+      return "a placement and its mirror land on different grids";
+
+    if (evaluate_game(&landed, NULL) != evaluate_game(&mirror_landed, NULL))
+      return "a placement and its mirror have different values";
+  }
+
+  return NULL;
+}
+
+
+/**
+ * @brief Plays a game landing every pill on a random placement, checking its mirror at every new pill with
+ * `check_mirror_position()`.
+ * @param seed Seed of the game and of the player.
+ * @param positions Incremented by the number of positions checked.
+ * @param symmetric Incremented by the number of symmetric positions.
+ * @param landings Incremented by the number of placements landed on both sides.
+ * @return bool Returns `false` at the first failure, after printing it.
+ */
+bool check_mirror_game(uint64_t seed, long long *positions, long long *symmetric, long long *landings) {
+  static struct placements placements;
+  struct game game;
+  struct rng rng;
+  int difficulty = (int) (seed % 16);
+
+  init_game(&game, seed);
+  fill_grid(&game, difficulty);
+
+  rng = game.rng;
+  rng_jump(&rng);
+
+  while (game.status == RUNNING) {
+    while (game.status == RUNNING && !game.pill.active)
+      execute(&game, NONE);
+
+    if (game.status != RUNNING)
+      break;
+
+    const char *failure = check_mirror_position(&game, symmetric, landings);
+
+    (*positions)++;
+
+    if (failure) {
+      struct tick_state state, mirror_state;
+      struct game mirror;
+
+      mirror_game(&game, &mirror);
+      get_state(&state, &game);
+      get_state(&mirror_state, &mirror);
+      printf("seed %llu (difficulty %d), pill %d: %s\n", (unsigned long long) seed, difficulty, game.pills_count,
+             failure);
+      print_states(&state, &mirror_state, "game", "mirror");
+      return false;
+    }
+
+    int count = find_placements(&game, &placements);
+
+    if (count == 0)
+      break;
+
+    land_placement(&game, &placements.placement[rng_below(&rng, (uint32_t) count)]);
+  }
+
+  return true;
+}
+
+
+void usage() {
+  fprintf(stderr, "DR.MAURO - differential test of the engine against the reference one\n"
+          "Usage: drmauro_diff [-s SEED] [-n GAMES] [-m TICKS] [-r] [-h]\n"
+          "\n"
+          "OPTIONS:\n"
+          "  -s SEED         First seed, the games use consecutive seeds (default 1)\n"
+          "  -n GAMES        Number of games (default 10000)\n"
+          "  -m TICKS        Ticks after which a game is left unfinished (default 10000)\n"
+          "  -r              Check every new pill against the left-right mirror of the game instead\n"
+          "  -h              Show this help message\n"
+          );
+  exit(1);
+}
+
+
+int main(int argc, char **argv) {
+  unsigned long long first_seed = 1;
+  long long games = 10000;
+  int max_ticks = 10000;
+  long long ticks = 0;
+  long long positions = 0, symmetric = 0, landings = 0;
+  bool mirror = false;
+  int c;
+
+  while ((c = getopt(argc, argv, "s:n:m:rh")) != -1) {
+    switch (c) {
+      case 's': first_seed = strtoull(optarg, NULL, 10); break;
+      case 'n': games = atoll(optarg); break;
+      case 'm': max_ticks = atoi(optarg); break;
+      case 'r': mirror = true; break;
+      default: usage();
+    }
+  }
+
+  if (optind < argc || games <= 0 || max_ticks <= 0)
+    usage();
+
+  if (mirror) {
+    for (long long i = 0; i < games; i++) {
+      if (!check_mirror_game(first_seed + (uint64_t) i, &positions, &symmetric, &landings))
+        return EXIT_FAILURE;
+    }
+
+    printf("%lld games, %lld positions (%lld symmetric), %lld placements: no divergence\n", games, positions,
+           symmetric, landings);
+
+    return EXIT_SUCCESS;
+  }
+
+  for (long long i = 0; i < games; i++) {
+    if (!compare_game(first_seed + (uint64_t) i, max_ticks, &ticks))
+      return EXIT_FAILURE;
+  }
+
+  printf("%lld games, %lld ticks: no divergence\n", games, ticks);
+
+  return EXIT_SUCCESS;
+}
@@ -19,10 +19,13 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <getopt.h>
+#include <time.h>
 
 #include "SDL2/SDL.h"
 #include "game.h"
 #include "drmauro.h"
+#include "replay.h"
+#include "bot.h"
 
 #define TITLE "DR. MAURO"
 #define WIDTH 480
@@ -135,7 +138,7 @@ void draw_background(SDL_Surface *screen,  struct game *game_state) {
     font_draw_string(dr_font, screen, scores,x+20,y+48, 1);
     for (i=0; i < ROWS; i++)
       for (j=0; j < COLUMNS; j++)
-        if (game_state->grid[i][j].type == VIRUS) virus++;
+        if (get_cell(game_state, i, j).type == VIRUS) virus++;
     font_draw_string(dr_font, screen, "VIRUS", x+20, y+64,1);
     sprintf(scores, "%06d", virus);
     font_draw_string(dr_font, screen, scores, x+20, y+80, 1);
@@ -154,11 +157,11 @@ void draw_board(SDL_Surface *screen,  struct game *game_state) {
   int i, j;
   for (i=0; i < ROWS; i++)
     for (j=0; j < COLUMNS; j++) {
-      struct cell *cell = &game_state->grid[i][j];
-      switch (cell->type) {
+      struct cell cell = get_cell(game_state, i, j);
+      switch (cell.type) {
       case VIRUS:
       case PILL:
-        sprite_draw(((cell->type == VIRUS) ? enemies : pills)[cell->color],
+        sprite_draw(((cell.type == VIRUS) ? enemies : pills)[cell.color],
                     screen, BOARD_X + j*16, BOARD_Y + i*16);
         break;
       default: /* do nothing */ break;
@@ -172,12 +175,17 @@ void draw_board(SDL_Surface *screen,  struct game *game_state) {
 
 void usage() {
   fprintf(stderr, "DR.MAURO - dr.Mario Clone                        \n"
-          "Usage: drmauro [-f FILE | -d DIFFICULTY] [-s SPEED] [-h] \n"
+          "Usage: drmauro [-f FILE | -d DIFFICULTY] [-s SPEED] [-r SEED] [-o REPLAY [-k TICKS]] [-a] [-v] [-h]\n"
           "                                                         \n"
           "OPTIONS:                                                 \n"
           "  -f FILE         Load board from FILE                   \n"
           "  -d DIFFICULTY   Generate random board (default 5)      \n"
           "  -s SPEED        Game speed (default 0.3 sec)           \n"
+          "  -r SEED         Seed of the game (default random)      \n"
+          "  -o REPLAY       Record the game in the file REPLAY     \n"
+          "  -k TICKS        Ticks between keyframes (default 250)  \n"
+          "  -a              Let the bot play                       \n"
+          "  -v              Print the grid at every step           \n"
           "  -h              Show this help message                 \n"
           );
   exit(1);
@@ -189,28 +197,41 @@ int main(int argc, char **argv) {
   SDL_Window *window;
   SDL_Surface *screen;
 
-  // Uses `srand()` with `time(NULL)` so that the allocation is not the same each time you play the game.
-  srand(time(NULL));
-
   int running = 1;
   enum command command = NONE;
   int prev_time;
   double acc_time;
 
   struct game *game;
+  enum error error;
   char *board_file = NULL;
   int difficulty = 5;
   double speed = 0.4;
+  int verbose = 0;
+  char *replay_file = NULL;
+  int keyframe_interval = 250;
+  struct replay_recorder recorder;
+  int autoplay = 0;
+  struct bot bot;
+  struct bot_player *player = NULL;
+  struct transposition_table table = { 0 };
+  // The seed defaults to the time, so that the allocation is not the same each time you play the game.
+  unsigned long long seed = (unsigned long long) time(NULL);
 
   extern char *optarg;
   extern int optind;
   char c;
   /* Parse command line arguments */
-  while ((c = getopt(argc, argv, "f:d:s:h")) != -1) {
+  while ((c = getopt(argc, argv, "f:d:s:r:o:k:avh")) != -1) {
     switch (c) {
     case 'f': board_file = optarg;       break;
     case 'd': difficulty = atoi(optarg); break;
     case 's': speed = atof(optarg);      break;
+    case 'r': seed = strtoull(optarg, NULL, 10); break;
+    case 'o': replay_file = optarg;      break;
+    case 'k': keyframe_interval = atoi(optarg); break;
+    case 'a': autoplay = 1;              break;
+    case 'v': verbose = 1;               break;
     case 'h': usage();                   break;
     default:  usage();
     }
@@ -221,15 +242,28 @@ int main(int argc, char **argv) {
 
 
   /* Initialize the game */
-  game = calloc(1, sizeof(struct game));
-  game->pills_count = 0;
-  game->virus_count = 0;
-  game->score = 0;
-  game->points_multiplier = 1;
-  game->moving_pill = game->pill;
-
+  game = malloc(sizeof(struct game));
   if (!game) ERROR(("malloc error"));
 
+  init_game(game, seed);
+
+  if (verbose)
+    set_logger(game, LOG_DEBUG, log_to_stream, stdout);
+
+  /* The bot looks three pills ahead on all the cores, within half a tick, sharing a table of 16 MB */
+  if (autoplay) {
+    init_bot(&bot);
+    bot.depth = 3;
+    bot.threads = SDL_GetCPUCount();
+    if (bot.threads > MAX_BOT_THREADS) bot.threads = MAX_BOT_THREADS;
+    bot.time_budget = speed / 2;
+    if (!init_transposition_table(&table, 16 << 20)) ERROR(("malloc error"));
+    bot.table = &table;
+    player = malloc(sizeof(struct bot_player));
+    if (!player) ERROR(("malloc error"));
+    init_bot_player(player, &bot);
+  }
+
   /* Initialize SDL */
   if (SDL_Init(SDL_INIT_VIDEO) <0) ERROR(("SDL_INIT failed!"));
   window = SDL_CreateWindow(TITLE,
@@ -241,13 +275,18 @@ int main(int argc, char **argv) {
   /* Load Sprites and images */
   load_spites();
 
-  init_grid(game);
-
   if (board_file)
-    // Use `-f /Users/fff/Documents/Git/dr_mauro/campo2.txt` as program argument, or another file.
-    load_grid(game, board_file);
+    // Use `-f campo2.txt` as program argument, or another file.
+    error = load_grid(game, board_file);
   else
-    fill_grid(game, difficulty);
+    error = fill_grid(game, difficulty);
+
+  if (error != NO_ERROR) ERROR(("%s", get_error_message(error)));
+
+  if (replay_file) {
+    error = replay_create(&recorder, replay_file, seed, difficulty, board_file, keyframe_interval);
+    if (error != NO_ERROR) ERROR(("%s: %s", replay_file, get_error_message(error)));
+  }
 
   prev_time = SDL_GetTicks();
   acc_time = 0;
@@ -284,19 +323,23 @@ int main(int argc, char **argv) {
       switch(victory(game)) {
         case DEFEAT:
           running = 0;
-          printf("Game Over. \nScore: %d\n", game->score);
+          printf("Game Over. \nScore: %d\nSeed: %llu\n", game->score, seed);
           break;
 
         case VICTORY:
           running = 0;
-          printf("You won! \nScore: %d\n", game->score);
+          printf("You won! \nScore: %d\nSeed: %llu\n", game->score, seed);
           break;
 
         default:
           break;
       }
-      /* Update State */
-      execute(game, command);
+      /* Update State, unless the game is over: the replay ends on its last tick */
+      if (victory(game) == RUNNING) {
+        if (autoplay) command = bot_next_command(player, game);
+        execute(game, command);
+        if (replay_file) replay_record(&recorder, game, command);
+      }
 
       /* Reset Commands */
       command = NONE;
@@ -311,7 +354,15 @@ int main(int argc, char **argv) {
     SDL_Delay(1);
   }
 
+  if (replay_file) {
+    error = replay_finish(&recorder, game);
+    if (error != NO_ERROR) fprintf(stderr, "%s: %s\n", replay_file, get_error_message(error));
+  }
+
   free_sprites();
+  if (player) free_bot_player(player);
+  free(player);
+  free_transposition_table(&table);
   free(game);
 
   SDL_DestroyWindow(window);
@@ -0,0 +1,744 @@
+#include <stdio.h>
+#include <math.h>
+#include <string.h>
+
+#include "drmauro_ref.h"
+
+
+/**
+ * @brief Returns `true` if the coordinates (row, column) are inside the grid.
+ * @param row Position on the y-axis.
+ * @param column Position on the x-axis.
+ * @return bool
+ */
+bool ref_is_inside_grid(int row, int column) {
+  return row >= 0 && row < ROWS && column >= 0 && column < COLUMNS;
+}
+
+
+/**
+ * @brief Returns the type of the cell at the coordinates (row, column). Cells outside the grid are empty.
+ * @param game Pointer to the game instance.
+ * @param row Position on the y-axis.
+ * @param column Position on the x-axis.
+ * @return content
+ */
+enum content ref_get_type(const struct ref_game *game, int row, int column) {
+  return ref_is_inside_grid(row, column) ? game->grid[row][column].type : EMPTY;
+}
+
+
+/**
+ * @brief Returns the content of the cell at the coordinates (row, column), the same way `get_cell()` does. The link
+ * points to the adjacent half having the same identifier.
+ * @param game Pointer to the game instance.
+ * @param row Position on the y-axis.
+ * @param column Position on the x-axis.
+ * @return cell
+ */
+struct cell ref_get_cell(const struct ref_game *game, int row, int column) {
+  struct cell cell = { EMPTY, BLANK, UNLINKED };
+
+  if (!ref_is_inside_grid(row, column) || game->grid[row][column].type == EMPTY)
+    return cell;
+
+  const struct ref_cell *c = &game->grid[row][column];
+
+  cell.type = c->type;
+  cell.color = c->color;
+
+  if (c->type != PILL)
+    return cell;
+
+  if (ref_is_inside_grid(row, column + 1) && game->grid[row][column + 1].type == PILL &&
+      game->grid[row][column + 1].id == c->id)
+    cell.link = LINKED_RIGHT;
+  else if (ref_is_inside_grid(row + 1, column) && game->grid[row + 1][column].type == PILL &&
+           game->grid[row + 1][column].id == c->id)
+    cell.link = LINKED_DOWN;
+  else if (ref_is_inside_grid(row, column - 1) && game->grid[row][column - 1].type == PILL &&
+           game->grid[row][column - 1].id == c->id)
+    cell.link = LINKED_LEFT;
+  else if (ref_is_inside_grid(row - 1, column) && game->grid[row - 1][column].type == PILL &&
+           game->grid[row - 1][column].id == c->id)
+    cell.link = LINKED_UP;
+
+  return cell;
+}
+
+
+/**
+ * @brief Empties the cell at the coordinates (row, column). Cells outside the grid are ignored.
+ * @param game Pointer to the game instance.
+ * @param row Position on the y-axis.
+ * @param column Position on the x-axis.
+ */
+void ref_clear_cell(struct ref_game *game, int row, int column) {
+  if (!ref_is_inside_grid(row, column))
+    return;
+
+  game->grid[row][column].id = 0;
+  game->grid[row][column].type = EMPTY;
+  game->grid[row][column].color = BLANK;
+}
+
+
+/**
+ * @brief Puts a virus or a pill's half in the cell at the coordinates (row, column). Cells outside the grid are ignored.
+ * @param game Pointer to the game instance.
+ * @param row Position on the y-axis.
+ * @param column Position on the x-axis.
+ * @param type Virus or pill.
+ * @param color Color of the virus or the half.
+ * @param id Identifier of the pill, `0` for viruses.
+ */
+void ref_set_cell(struct ref_game *game, int row, int column, enum content type, enum color color, int id) {
+  if (!ref_is_inside_grid(row, column))
+    return;
+
+  game->grid[row][column].id = id;
+  game->grid[row][column].type = type;
+  game->grid[row][column].color = color;
+}
+
+
+/**
+ * @brief Prepares a new game, the same way `init_game()` does.
+ * @param game Pointer to the game instance.
+ * @param seed Seed of the random generator.
+ */
+void ref_init_game(struct ref_game *game, uint64_t seed) {
+  memset(game, 0, sizeof(struct ref_game));
+
+  game->points_multiplier = 1;
+  rng_seed(&game->rng, seed);
+
+  for (int i = 0; i < ROWS; i++)
+    for (int j = 0; j < COLUMNS; j++)
+      ref_clear_cell(game, i, j);
+}
+
+
+/**
+ * @brief Assigns a new color to the virus at the coordinates (x, y) of the grid.
+ * @param game Pointer to the game instance.
+ * @param x Position on the x-axis.
+ * @param y Position on the y-axis.
+ */
+void ref_change_virus_color(struct ref_game *game, int x, int y) {
+  int current_color = game->grid[x][y].color;
+  int new_color;
+
+  do {
+    new_color = (int) rng_below(&game->rng, BLANK);
+  } while (new_color == current_color);
+
+  game->grid[x][y].color = (enum color) new_color;
+}
+
+
+/**
+ * @brief Returns `true` if the cell at the coordinates (row, column) holds a virus of the given color.
+ * @param game Pointer to the game instance.
+ * @param row Position on the y-axis.
+ * @param column Position on the x-axis.
+ * @param color A color.
+ * @return bool
+ */
+bool ref_is_virus(const struct ref_game *game, int row, int column, enum color color) {
+  return ref_get_type(game, row, column) == VIRUS && game->grid[row][column].color == color;
+}
+
+
+/**
+ * @brief Reorganizes the viruses to avoid the presence of three consecutive viruses of the same color on the same line.
+ * @param game Pointer to the game instance.
+ */
+void ref_reorganize_viruses(struct ref_game *game) {
+  for (int x = INVALIDE_ROWS; x < ROWS; x++) {
+    for (int y = 0; y < COLUMNS; y++) {
+      if (game->grid[x][y].type == EMPTY)
+        continue;
+
+      game->virus_count++;
+
+      enum color color = game->grid[x][y].color;
+
+      if ((ref_is_virus(game, x, y - 1, color) && ref_is_virus(game, x, y - 2, color)) ||
+          (ref_is_virus(game, x - 1, y, color) && ref_is_virus(game, x - 2, y, color)))
+        ref_change_virus_color(game, x, y);
+    }
+  }
+}
+
+
+/**
+ * @brief Loads the grid from a text file, the same way `load_grid()` does.
+ * @param game Pointer to the game instance.
+ * @param path The filepath of the text file.
+ * @return error `NO_ERROR`, or the reason why the grid could not be loaded.
+ */
+enum error ref_load_grid(struct ref_game *game, const char *path) {
+  FILE *fp = fopen(path, "r");
+  int character;
+  int x = 0, y = 0;
+
+  if (!fp)
+    return CANNOT_OPEN_FILE;
+
+  do {
+    character = fgetc(fp);
+
+    switch (character) {
+      case 'R':
+        ref_set_cell(game, x, y++, VIRUS, RED, 0);
+        break;
+      case 'Y':
+        ref_set_cell(game, x, y++, VIRUS, YELLOW, 0);
+        break;
+      case 'B':
+        ref_set_cell(game, x, y++, VIRUS, BLUE, 0);
+        break;
+      case ' ':
+        y++;
+        break;
+      case '\n':
+        x++;
+        y = 0;
+        break;
+      case EOF:
+        break;
+      default:
+        fclose(fp);
+
+        for (int i = 0; i < ROWS; i++)
+          for (int j = 0; j < COLUMNS; j++)
+            ref_clear_cell(game, i, j);
+
+        return INVALID_CHARACTER;
+    }
+  } while (character != EOF);
+
+  fclose(fp);
+
+  ref_reorganize_viruses(game);
+
+  return NO_ERROR;
+}
+
+
+/**
+ * @brief Fills the grid with the viruses, the same way `fill_grid()` does.
+ * @param game Pointer to the game instance.
+ * @param difficulty Level of difficulty chosen for the game, between 0 and 15.
+ * @return error `NO_ERROR`, or `INVALID_DIFFICULTY` leaving the grid untouched.
+ */
+enum error ref_fill_grid(struct ref_game *game, int difficulty) {
+  if (difficulty < 0 || difficulty > 15)
+    return INVALID_DIFFICULTY;
+
+  const int cell_count = (ROWS * COLUMNS) - (INVALIDE_ROWS * COLUMNS);
+  const int virus_count = cell_count - (4 * (difficulty + 1));
+  int cells[cell_count];
+
+  // Colors.
+  for (int i = 0; i < cell_count; i++)
+    cells[i] = (int) rng_below(&game->rng, 3);
+
+  // Viruses in surplus.
+  for (int k = 0; k < virus_count; ) {
+    int i = (int) rng_below(&game->rng, (uint32_t) cell_count);
+
+    if (cells[i] == -1)
+      continue;
+
+    cells[i] = -1;
+    k++;
+  }
+
+  // Fisher-Yates shuffle.
+  for (int i = cell_count - 1; i > 0; i--) {
+    int j = (int) rng_below(&game->rng, (uint32_t) i + 1);
+    int tmp = cells[j];
+
+    cells[j] = cells[i];
+    cells[i] = tmp;
+  }
+
+  for (int i = 0; i < INVALIDE_ROWS; i++)
+    for (int j = 0; j < COLUMNS; j++)
+      game->grid[i][j].type = EMPTY;
+
+  for (int i = INVALIDE_ROWS, k = 0; i < ROWS; i++) {
+    for (int j = 0; j < COLUMNS; j++, k++) {
+      if (cells[k] != -1) {
+        game->grid[i][j].type = VIRUS;
+        game->grid[i][j].color = (enum color) cells[k];
+      }
+      else {
+        game->grid[i][j].type = EMPTY;
+      }
+    }
+  }
+
+  ref_reorganize_viruses(game);
+
+  return NO_ERROR;
+}
+
+
+/**
+ * @brief Swap the color of the two halves of a pill.
+ * @param pill A pill.
+ */
+void ref_swap_color(struct pill *pill) {
+  enum color tmp = pill->first_half.color;
+  pill->first_half.color = pill->second_half.color;
+  pill->second_half.color = tmp;
+}
+
+
+/**
+ * @brief Marks a group of four or more cells of a line (row or column) having the same color.
+ * @param game Pointer to the game instance.
+ * @param direction Direction of the line,
+ * @param index Index of the line (row o column) to be processed.
+ * @param offset Position on the row or column of the last cell of the group.
+ * @param repetitions Number of repetitions.
+ */
+void ref_mark_cells_for_emptying(struct ref_game *game, enum direction direction, int index, int offset,
+                                 int repetitions) {
+  for (int i = repetitions; i >= 0; i--) {
+    if (direction == HORIZONTAL)
+      game->grid[index][offset - i].to_be_emptied = true;
+    else
+      game->grid[offset - i][index].to_be_emptied = true;
+  }
+}
+
+
+/**
+ * @brief Process a single line of the grid, (row or column), marking the groups of cells to be emptied.
+ * @param game Pointer to the game instance.
+ * @param direction Horizontal for x-axis or vertical for y-axis.
+ * @param index Index of the line (row o column) to be processed.
+ */
+void ref_process_line(struct ref_game *game, enum direction direction, int index) {
+  int limit = direction == HORIZONTAL ? COLUMNS - 1 : ROWS - 1;
+  int repetitions = 0;
+
+  for (int j = 0; j < limit; j++) {
+    struct ref_cell *current_cell, *next_cell;
+
+    if (direction == HORIZONTAL) {
+      current_cell = &game->grid[index][j];
+      next_cell = &game->grid[index][j + 1];
+    }
+    else {
+      current_cell = &game->grid[j][index];
+      next_cell = &game->grid[j + 1][index];
+    }
+
+    if (current_cell->type == EMPTY) {
+      repetitions = 0;
+      continue;
+    }
+
+    if (next_cell->type != EMPTY && current_cell->color == next_cell->color) {
+      repetitions++;
+
+      if (j + 1 == limit && repetitions >= MIN_ELEMENTS - 1)
+        ref_mark_cells_for_emptying(game, direction, index, limit, repetitions);
+    }
+    else {
+      if (repetitions >= MIN_ELEMENTS - 1)
+        ref_mark_cells_for_emptying(game, direction, index, j, repetitions);
+
+      repetitions = 0;
+    }
+  }
+}
+
+
+/**
+ * @brief Empty the marked cells, and scores the viruses killed.
+ * @param game Pointer to the game instance.
+ * @return bool Returns `true` if any cells have been emptied, `false` otherwise.
+ */
+bool ref_empty_cells(struct ref_game *game) {
+  bool is_changed = false;
+  int virus_killed = 0;
+
+  for (int r = 0; r < ROWS; r++) {
+    for (int c = 0; c < COLUMNS; c++) {
+      struct ref_cell *cell = &game->grid[r][c];
+
+      if (!cell->to_be_emptied)
+        continue;
+
+      if (cell->type == VIRUS)
+        virus_killed++;
+
+      ref_clear_cell(game, r, c);
+      cell->to_be_emptied = false;
+      is_changed = true;
+    }
+  }
+
+  int points = 0;
+  for (int i = 1; i <= virus_killed; i++)
+    points += (int)(game->points_multiplier * (100 * pow(2, i)));
+
+  if (virus_killed > 0) {
+    game->virus_count -= virus_killed;
+    game->score += points;
+    game->points_multiplier *= 2;
+  }
+
+  return is_changed;
+}
+
+
+/**
+ * @brief Given the coordinates of a cell, returns the last empty cell row, walking down the column.
+ * @param game Pointer to the game instance.
+ * @param orientation Horizontal when the cells of the next column must be empty too.
+ * @param row Position on the y-axis.
+ * @param column Position on the x-axis.
+ * @return int
+ */
+int ref_get_empty_cell_row_by_column(struct ref_game *game, enum direction orientation, int row, int column) {
+  int r = row;
+
+  while (r < ROWS - 1 && ref_get_type(game, r + 1, column) == EMPTY &&
+         (orientation == VERTICAL || ref_get_type(game, r + 1, column + 1) == EMPTY))
+    r++;
+
+  return r;
+}
+
+
+/**
+ * @brief Moves a half from a cell to another one.
+ * @param game Pointer to the game instance.
+ * @param row Position on the y-axis of the half.
+ * @param column Position on the x-axis of the half.
+ * @param new_row Position on the y-axis where the half is moved, on the same column.
+ */
+void ref_move_half(struct ref_game *game, int row, int column, int new_row) {
+  struct ref_cell cell = game->grid[row][column];
+
+  ref_clear_cell(game, row, column);
+  ref_set_cell(game, new_row, column, cell.type, cell.color, cell.id);
+}
+
+
+/**
+ * @brief Shakes the grid so the pill's halves drop till they find a virus, another pill or the bottom of the grid.
+ * @details The rows are processed from the bottom to the top, so every fragment falls on the ones below it which have
+ * already fallen.
+ * @param game Pointer to the game instance.
+ * @return bool Returns `true` if the grid changed and need to be processed again.
+ */
+bool ref_shake_grid(struct ref_game *game) {
+  bool is_changed = false;
+
+  for (int r = ROWS - 2; r >= 0; r--) {
+    for (int c = 0; c < COLUMNS; c++) {
+      struct ref_cell *cell = &game->grid[r][c];
+      int new_row;
+
+      // We can only drop pill's halves, not the viruses.
+      if (cell->type != PILL)
+        continue;
+
+      // The other half is above: the pill falls as a whole.
+      if (r > 0 && game->grid[r - 1][c].type == PILL && game->grid[r - 1][c].id == cell->id) {
+        new_row = ref_get_empty_cell_row_by_column(game, VERTICAL, r, c);
+
+        if (new_row != r) {
+          ref_move_half(game, r, c, new_row);
+          ref_move_half(game, r - 1, c, new_row - 1);
+          is_changed = true;
+        }
+
+        continue;
+      }
+
+      // The other half is on the left: it has already been moved with its left half.
+      if (c > 0 && game->grid[r][c - 1].type == PILL && game->grid[r][c - 1].id == cell->id)
+        continue;
+
+      // The other half is on the right: the pill falls only if the cells below both halves are empty.
+      if (c + 1 < COLUMNS && game->grid[r][c + 1].type == PILL && game->grid[r][c + 1].id == cell->id) {
+        new_row = ref_get_empty_cell_row_by_column(game, HORIZONTAL, r, c);
+
+        if (new_row != r) {
+          ref_move_half(game, r, c, new_row);
+          ref_move_half(game, r, c + 1, new_row);
+          is_changed = true;
+        }
+
+        continue;
+      }
+
+      // A single half.
+      new_row = ref_get_empty_cell_row_by_column(game, VERTICAL, r, c);
+
+      if (new_row != r) {
+        ref_move_half(game, r, c, new_row);
+        is_changed = true;
+      }
+    }
+  }
+
+  return is_changed;
+}
+
+
+/**
+ * @brief Process the entire grid, as long as groups of cells are emptied.
+ * @param game Pointer to the game instance.
+ */
+void ref_process_grid(struct ref_game *game) {
+  if (game->pill.active)
+    return;
+
+  for (int i = ROWS - 1; i >= 0; i--)
+    ref_process_line(game, HORIZONTAL, i);
+
+  for (int i = 0; i < COLUMNS; i++)
+    ref_process_line(game, VERTICAL, i);
+
+  if (!ref_empty_cells(game))
+    return;
+
+  if (ref_shake_grid(game))
+    ref_process_grid(game);
+
+  game->points_multiplier = 1;
+
+  if (game->virus_count == 0)
+    game->status = VICTORY;
+}
+
+
+/**
+ * @brief Removes the current pill from the grid.
+ * @param game Pointer to the game instance.
+ */
+void ref_remove_active_pill_from_grid(struct ref_game *game) {
+  struct pill *p = &game->pill;
+
+  if (!p->active)
+    return;
+
+  ref_clear_cell(game, p->first_half.row, p->first_half.column);
+  ref_clear_cell(game, p->second_half.row, p->second_half.column);
+}
+
+
+/**
+ * @brief Restores the current pill on the grid.
+ * @param game Pointer to the game instance.
+ */
+void ref_restore_active_pill_to_grid(struct ref_game *game) {
+  struct pill *p = &game->pill;
+
+  if (!p->active)
+    return;
+
+  ref_set_cell(game, p->first_half.row, p->first_half.column, PILL, p->first_half.color, game->pill_id);
+  ref_set_cell(game, p->second_half.row, p->second_half.column, PILL, p->second_half.color, game->pill_id);
+}
+
+
+/**
+ * @brief Refreshes the grid because the pill moved.
+ * @param game Pointer to the game instance.
+ */
+void ref_refresh_grid(struct ref_game *game) {
+  struct pill *pill = &game->pill;
+  struct pill *moving_pill = &game->moving_pill;
+
+  if (!pill->active)
+    return;
+
+  int r1 = moving_pill->first_half.row;
+  int c1 = moving_pill->first_half.column;
+  int r2 = moving_pill->second_half.row;
+  int c2 = moving_pill->second_half.column;
+
+  ref_remove_active_pill_from_grid(game);
+
+  if (r1 > ROWS - 1 || c1 > COLUMNS - 1 || r2 > ROWS - 1 || c2 > COLUMNS - 1 || c1 < 0 || c2 < 0) {
+    ref_restore_active_pill_to_grid(game);
+    return;
+  }
+
+  if (ref_get_type(game, r1, c1) != EMPTY || ref_get_type(game, r2, c2) != EMPTY) {
+    if (r1 == 0 && c1 == (COLUMNS / 2) - 1)
+      game->status = DEFEAT;
+
+    ref_restore_active_pill_to_grid(game);
+    return;
+  }
+
+  ref_set_cell(game, r1, c1, PILL, moving_pill->first_half.color, game->pill_id);
+  ref_set_cell(game, r2, c2, PILL, moving_pill->second_half.color, game->pill_id);
+
+  if (r1 == ROWS - 1 || ref_get_type(game, r1 + 1, c1) != EMPTY ||
+      (moving_pill->orientation == HORIZONTAL && ref_get_type(game, r2 + 1, c2) != EMPTY))
+    moving_pill->active = false;
+
+  *pill = *moving_pill;
+
+  game->status = RUNNING;
+
+  ref_process_grid(game);
+}
+
+
+/**
+ * @brief Rotates the pill clockwise or anti-clockwise.
+ * @param game Pointer to the game instance.
+ * @param direction The direction of rotation.
+ */
+void ref_rotate_pill(struct ref_game *game, enum rotation direction) {
+  if (!game->pill.active)
+    return;
+
+  struct pill temp = game->pill;
+
+  if (temp.orientation == HORIZONTAL) {
+    temp.second_half.row--;
+    temp.second_half.column--;
+
+    if (direction == CLOCKWISE)
+      ref_swap_color(&temp);
+
+    temp.orientation = VERTICAL;
+  }
+  else {
+    temp.second_half.row++;
+    temp.second_half.column++;
+
+    // If the second half of the pill ends on an occupied cell, then shift to the left the entire pill.
+    if (temp.second_half.column == COLUMNS || ref_get_type(game, temp.second_half.row, temp.second_half.column) != EMPTY) {
+      temp.first_half.column--;
+      temp.second_half.column--;
+    }
+
+    if (direction == ANTICLOCKWISE)
+      ref_swap_color(&temp);
+
+    temp.orientation = HORIZONTAL;
+  }
+
+  game->moving_pill = temp;
+}
+
+
+/**
+ * @brief Moves the pill.
+ * @param game Pointer to the game instance.
+ * @param direction Direction of the pill.
+ */
+void ref_move_pill(struct ref_game *game, enum command direction) {
+  if (!game->pill.active)
+    return;
+
+  struct pill temp = game->pill;
+
+  switch (direction) {
+    case RIGHT:
+      temp.first_half.column++;
+      temp.second_half.column++;
+      break;
+
+    case LEFT:
+      temp.first_half.column--;
+      temp.second_half.column--;
+      break;
+
+    case DOWN: {
+      int i = temp.first_half.row + 1;
+
+      while (i < ROWS && ref_get_type(game, i, temp.first_half.column) == EMPTY &&
+             ref_get_type(game, i, temp.second_half.column) == EMPTY)
+        i++;
+
+      temp.first_half.row = i - 1;
+      temp.second_half.row = temp.orientation == HORIZONTAL ? i - 1 : i - 2;
+      break;
+    }
+
+    case NONE:
+      temp.first_half.row++;
+      temp.second_half.row++;
+      break;
+
+    default:
+      return;
+  }
+
+  game->moving_pill = temp;
+}
+
+
+/**
+ * @brief Creates a new pill at the top of the grid.
+ * @param game Pointer to the game instance.
+ */
+void ref_create_pill(struct ref_game *game) {
+  game->pill.orientation = HORIZONTAL;
+  game->pill.first_half.row = -1;
+  game->pill.second_half.row = -1;
+  game->pill.first_half.column = (COLUMNS / 2) - 1;
+  game->pill.second_half.column = game->pill.first_half.column + 1;
+  game->pill.first_half.color = (enum color) rng_below(&game->rng, BLANK);
+  game->pill.second_half.color = (enum color) rng_below(&game->rng, BLANK);
+
+  game->pills_count++;
+
+  // Every pill has an identifier, used to tell the two halves of the same pill in the grid.
+  game->pill_id = game->pills_count;
+
+  game->pill.active = true;
+  game->moving_pill = game->pill;
+}
+
+
+/**
+ * @brief Executes a command, the same way `execute()` does.
+ * @param game Pointer to the game instance.
+ * @param command Command given by the player.
+ */
+void ref_execute(struct ref_game *game, enum command command) {
+  switch (command) {
+    case RIGHT:
+    case LEFT:
+    case DOWN:
+      ref_move_pill(game, command);
+      break;
+
+    case CLOCKWISE_ROTATION:
+      ref_rotate_pill(game, CLOCKWISE);
+      break;
+
+    case ANTICLOCKWISE_ROTATION:
+      ref_rotate_pill(game, ANTICLOCKWISE);
+      break;
+
+    case NONE:
+      if (!game->pill.active)
+        ref_create_pill(game);
+      ref_move_pill(game, NONE);
+      break;
+
+    default:
+      break;
+  }
+
+  ref_refresh_grid(game);
+}
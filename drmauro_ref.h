@@ -0,0 +1,39 @@
+#ifndef DRMAURO_REF_H
+#define DRMAURO_REF_H
+
+#include "drmauro.h"
+
+
+/**
+ * The reference engine: the rules as they were first written, on a plain array of cells, kept to check that the
+ * optimized engine behaves exactly the same. The halves of the same pill share an identifier, instead of being linked.
+ * It's slow on purpose and it's not meant to be used by the games.
+ */
+struct ref_cell {
+  enum content type;
+  enum color color;
+  int id;
+  bool to_be_emptied;
+};
+
+struct ref_game {
+  struct ref_cell grid[ROWS][COLUMNS];
+  struct pill pill;
+  struct pill moving_pill;
+  int pill_id;
+  int pills_count;
+  int virus_count;
+  enum state status;
+  int score;
+  int points_multiplier;
+  struct rng rng;
+};
+
+
+void ref_init_game(struct ref_game *game, uint64_t seed);
+struct cell ref_get_cell(const struct ref_game *game, int row, int column);
+enum error ref_load_grid(struct ref_game *game, const char *path);
+enum error ref_fill_grid(struct ref_game *game, int difficulty);
+void ref_execute(struct ref_game *game, enum command command);
+
+#endif
@@ -0,0 +1,156 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <getopt.h>
+
+#include "drmauro.h"
+#include "replay.h"
+
+
+/**
+ * @brief Returns the names of the states of a game.
+ * @param status The state.
+ * @return const char*
+ */
+const char *get_status_name(enum state status) {
+  switch (status) {
+    case RUNNING:
+      return "unfinished";
+    case VICTORY:
+      return "victory";
+    case DEFEAT:
+      return "defeat";
+    default:
+      return "unknown";
+  }
+}
+
+
+/**
+ * @brief Returns the time elapsed from an arbitrary point, in seconds.
+ * @return double
+ */
+double get_time() {
+  struct timespec now;
+
+  clock_gettime(CLOCK_MONOTONIC, &now);
+
+  return (double) now.tv_sec + (double) now.tv_nsec * 1e-9;
+}
+
+
+/**
+ * @brief Plays a replay again and checks that it ends with the score and the state it claims.
+ * @param path The filepath of the replay.
+ * @param max_ticks Replays longer than this are rejected, without playing them.
+ * @param seek_tick Tick whose grid is printed, reached from the nearest keyframe, or -1.
+ * @param print Prints the final grid.
+ * @return bool Returns `true` when the replay is valid and its claims are confirmed.
+ */
+bool check_replay(const char *path, long long max_ticks, long long seek_tick, bool print) {
+  struct replay replay;
+  enum error error = replay_load(&replay, path);
+
+  if (error != NO_ERROR) {
+    printf("%s: %s\n", path, get_error_message(error));
+    return false;
+  }
+
+  if (replay.ticks > max_ticks) {
+    printf("%s: %lld ticks, longer than %lld\n", path, replay.ticks, max_ticks);
+    replay_free(&replay);
+    return false;
+  }
+
+  struct game *game = malloc(sizeof(struct game));
+
+  if (!game) {
+    fprintf(stderr, "malloc error\n");
+    exit(1);
+  }
+
+  long long ticks;
+  double start = get_time();
+  error = replay_play(&replay, game, &ticks);
+  double elapsed = get_time() - start;
+
+  bool valid = error == NO_ERROR && game->score == replay.score && game->status == replay.status;
+
+  if (error != NO_ERROR)
+    printf("%s: %s\n", path, get_error_message(error));
+  else
+    printf("%s: seed %llu, %s %d, %lld ticks (%.1f M/s), %zu keyframes, claims %s with %d, plays %s with %d: %s\n",
+           path, (unsigned long long) replay.seed, replay.difficulty < 0 ? "board file" : "difficulty",
+           replay.difficulty < 0 ? (int) replay.board_size : replay.difficulty, ticks,
+           elapsed > 0 ? (double) ticks / elapsed * 1e-6 : 0.0, replay.keyframes_count, get_status_name(replay.status),
+           replay.score, get_status_name(game->status), game->score, valid ? "OK" : "MISMATCH");
+
+  if (print && error == NO_ERROR)
+    print_grid(game);
+
+  // A replay which cannot be played is not trusted for seeking either: its keyframes are the states seeked from.
+  if (seek_tick >= 0 && error == NO_ERROR) {
+    start = get_time();
+    error = replay_seek(&replay, game, seek_tick);
+    elapsed = get_time() - start;
+
+    if (error != NO_ERROR) {
+      printf("%s: cannot seek tick %lld: %s\n", path, seek_tick, get_error_message(error));
+      valid = false;
+    } else {
+      printf("%s: tick %lld reached in %.1f us, score %d\n", path, seek_tick, elapsed * 1e6, game->score);
+      print_grid(game);
+    }
+  }
+
+  free(game);
+  replay_free(&replay);
+
+  return valid;
+}
+
+
+void usage() {
+  fprintf(stderr, "DR.MAURO - replay checker\n"
+          "Usage: drmauro_replay [-m TICKS] [-s TICK] [-p] [-h] REPLAY...\n"
+          "\n"
+          "Plays every replay again, as fast as possible, and checks that it ends with the score and the state\n"
+          "it claims. The exit status is not zero when any replay fails.\n"
+          "\n"
+          "OPTIONS:\n"
+          "  -m TICKS        Reject the replays longer than TICKS (default 100000000)\n"
+          "  -s TICK         Print the grid at TICK, reached from the nearest keyframe\n"
+          "  -p              Print the final grid of every replay\n"
+          "  -h              Show this help message\n"
+          );
+  exit(1);
+}
+
+
+int main(int argc, char **argv) {
+  long long max_ticks = 100000000;
+  long long seek_tick = -1;
+  bool print = false;
+  int c;
+
+  while ((c = getopt(argc, argv, "m:s:ph")) != -1) {
+    switch (c) {
+      case 'm': max_ticks = atoll(optarg); break;
+      case 's': seek_tick = atoll(optarg); break;
+      case 'p': print = true; break;
+      default: usage();
+    }
+  }
+
+  if (optind == argc || max_ticks <= 0)
+    usage();
+
+  bool valid = true;
+
+  for (int i = optind; i < argc; i++)
+    valid &= check_replay(argv[i], max_ticks, seek_tick, print);
+
+  return valid ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,618 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <time.h>
+#include <unistd.h>
+#include <getopt.h>
+#include <pthread.h>
+
+#include "drmauro.h"
+#include "bot.h"
+
+#define MAX_SCRIPT_LENGTH 4096
+
+
+/******************************************************************************/
+/* POLICIES                                                                   */
+
+enum policy { RANDOM_POLICY, SCRIPTED_POLICY, BOT_POLICY, SEARCH_POLICY };
+
+/**
+ * The state of the player of a game. The random policy draws from its own stream, the scripted one repeats the
+ * commands of the script, the bot aims every pill at the column it chose when the pill appeared, the search one plays
+ * the placements chosen by the beam search of `bot.h`.
+ */
+struct player {
+  enum policy policy;
+  struct rng rng;
+  const enum command *script;
+  int script_length;
+  int position;
+  int pills_count;
+  int target;
+  int last_column;
+  struct bot_player searcher;
+};
+
+
+/**
+ * @brief Returns how much the bot likes to drop the current pill, lying horizontally, on the given column.
+ * @details A half is worth a point when it lands on a cell of its color. Tall columns are avoided, since they are the
+ * ones which end the game.
+ * @param game Pointer to the game instance.
+ * @param column The column of the first half of the pill.
+ * @return int
+ */
+int rate_column(const struct game *game, int column) {
+  const struct halve *halves[] = { &game->pill.first_half, &game->pill.second_half };
+  int rating = 0;
+
+  for (int i = 0; i < 2; i++) {
+    int landing_row = get_landing_row(game, 0, column + i);
+
+    if (landing_row < INVALIDE_ROWS - 1)
+      rating -= 4;
+
+    if (landing_row + 1 < ROWS && get_cell(game, landing_row + 1, column + i).color == halves[i]->color)
+      rating += 2;
+  }
+
+  return rating;
+}
+
+
+/**
+ * @brief Chooses the column where the bot drops the current pill.
+ * @param game Pointer to the game instance.
+ * @return int
+ */
+int choose_target(const struct game *game) {
+  int target = game->pill.first_half.column;
+  int best = rate_column(game, target);
+
+  for (int column = 0; column < COLUMNS - 1; column++) {
+    int rating = rate_column(game, column);
+
+    if (rating > best) {
+      best = rating;
+      target = column;
+    }
+  }
+
+  return target;
+}
+
+
+/**
+ * @brief Returns the next command of the player.
+ * @param player The player.
+ * @param game Pointer to the game instance.
+ * @return command
+ */
+enum command next_command(struct player *player, const struct game *game) {
+  switch (player->policy) {
+    case RANDOM_POLICY:
+      return (enum command) rng_below(&player->rng, ANTICLOCKWISE_ROTATION + 1);
+
+    case SCRIPTED_POLICY: {
+      enum command command = player->script[player->position++];
+
+      if (player->position == player->script_length)
+        player->position = 0;
+
+      return command;
+    }
+
+    case BOT_POLICY:
+      if (!game->pill.active)
+        return NONE;
+
+      // Every new pill gets its own target. When the pill could not move towards it, the pill is dropped where it is.
+      if (game->pills_count != player->pills_count) {
+        player->pills_count = game->pills_count;
+        player->target = choose_target(game);
+      } else if (game->pill.first_half.column == player->last_column) {
+        player->target = player->last_column;
+      }
+
+      player->last_column = game->pill.first_half.column;
+
+      if (game->pill.first_half.column < player->target)
+        return RIGHT;
+      if (game->pill.first_half.column > player->target)
+        return LEFT;
+
+      return DOWN;
+
+    case SEARCH_POLICY:
+      return bot_next_command(&player->searcher, game);
+
+    default:
+      return NONE;
+  }
+}
+
+
+/**
+ * @brief Reads a script of commands from a file.
+ * @details Every character is a command, with the same keys of the frontend: `l` left, `r` right, `d` down, `x`
+ * clockwise rotation, `z` anti-clockwise rotation, `.` no command. Blanks are ignored.
+ * @param path The filepath of the script.
+ * @param script Receives the commands, at most `MAX_SCRIPT_LENGTH`.
+ * @return int The number of commands read, or `-1` in case of error, or if the script is longer than
+ * `MAX_SCRIPT_LENGTH`.
+ */
+int load_script(const char *path, enum command *script) {
+  FILE *fp = fopen(path, "r");
+  int length = 0;
+  int character;
+
+  if (!fp)
+    return -1;
+
+  while ((character = fgetc(fp)) != EOF) {
+    enum command command;
+
+    switch (tolower(character)) {
+      case 'l': command = LEFT; break;
+      case 'r': command = RIGHT; break;
+      case 'd': command = DOWN; break;
+      case 'x': command = CLOCKWISE_ROTATION; break;
+      case 'z': command = ANTICLOCKWISE_ROTATION; break;
+      case '.': command = NONE; break;
+      default:
+        if (isspace(character))
+          continue;
+
+        fclose(fp);
+        return -1;
+    }
+
+    // A script too long is refused, rather than played cut short.
+    if (length == MAX_SCRIPT_LENGTH) {
+      fclose(fp);
+      return -1;
+    }
+
+    script[length++] = command;
+  }
+
+  fclose(fp);
+
+  return length;
+}
+
+
+/******************************************************************************/
+/* RUNNER                                                                     */
+
+struct result {
+  int score;
+  int pills_count;
+  int ticks;
+  enum state status;
+  long long allocations;
+  long long heap_allocations;
+  struct table_stats table;
+};
+
+struct runner {
+  uint64_t first_seed;
+  int min_difficulty;
+  int max_difficulty;
+  int max_ticks;
+  enum policy policy;
+  const enum command *script;
+  int script_length;
+  struct bot bot;
+  size_t table_size;
+  struct result *results;
+  struct worker *workers;
+  int workers_count;
+};
+
+/**
+ * A thread of the runner. It plays the seeds of its range from the front and, once the range is over, steals the back
+ * half of the range of another worker. Its bot has its own transposition table, if any, emptied at every game.
+ */
+struct worker {
+  pthread_t thread;
+  struct bot bot;
+  struct transposition_table table;
+  pthread_mutex_t lock;
+  uint64_t next;
+  uint64_t end;
+  int steals;
+  int id;
+  struct runner *runner;
+};
+
+
+/**
+ * @brief Plays a whole game, until it's over or it lasts `max_ticks` ticks.
+ * @param runner The runner.
+ * @param bot The bot of the search policy.
+ * @param seed Seed of the game.
+ * @param result Receives the result of the game.
+ */
+void play_game(const struct runner *runner, const struct bot *bot, uint64_t seed, struct result *result) {
+  struct game game;
+  struct player player;
+  int difficulty = runner->min_difficulty + (int) (seed % (uint64_t) (runner->max_difficulty - runner->min_difficulty + 1));
+
+  init_game(&game, seed);
+  fill_grid(&game, difficulty);
+
+  // The commands of the random policy are drawn from a stream of the seed independent from the one of the game.
+  memset(&player, 0, sizeof(struct player));
+
+  // Only the search policy plays with the bot of `bot.h`, and needs its workspace.
+  if (runner->policy == SEARCH_POLICY) {
+    init_bot_player(&player.searcher, bot);
+
+    if (bot->table)
+      clear_transposition_table(bot->table);
+  }
+
+  player.policy = runner->policy;
+  player.rng = game.rng;
+  rng_jump(&player.rng);
+  player.script = runner->script;
+  player.script_length = runner->script_length;
+
+  result->ticks = 0;
+
+  while (victory(&game) == RUNNING && result->ticks < runner->max_ticks) {
+    execute(&game, next_command(&player, &game));
+    result->ticks++;
+  }
+
+  result->score = game.score;
+  result->pills_count = game.pills_count;
+  result->status = victory(&game);
+  result->allocations = 0;
+  result->heap_allocations = 0;
+  result->table = player.searcher.table_stats;
+
+  if (runner->policy == SEARCH_POLICY) {
+    for (int t = 0; t < MAX_BOT_THREADS; t++) {
+      result->allocations += player.searcher.workspace.arenas[t].allocations;
+      result->heap_allocations += player.searcher.workspace.arenas[t].heap_allocations;
+    }
+
+    free_bot_player(&player.searcher);
+  }
+}
+
+
+/**
+ * @brief Takes the next seed to be played from the range of the worker.
+ * @param worker The worker.
+ * @param seed Receives the seed.
+ * @return bool Returns `false` if the range is over.
+ */
+bool take_seed(struct worker *worker, uint64_t *seed) {
+  bool taken = false;
+
+  pthread_mutex_lock(&worker->lock);
+
+  if (worker->next < worker->end) {
+    *seed = worker->next++;
+    taken = true;
+  }
+
+  pthread_mutex_unlock(&worker->lock);
+
+  return taken;
+}
+
+
+/**
+ * @brief Moves to the worker the back half of the range of the first other worker which has some seeds left.
+ * @param worker The worker, whose range is over.
+ * @return bool Returns `false` if no other worker has seeds left.
+ */
+bool steal_seeds(struct worker *worker) {
+  struct runner *runner = worker->runner;
+
+  for (int i = 1; i < runner->workers_count; i++) {
+    struct worker *victim = &runner->workers[(worker->id + i) % runner->workers_count];
+    uint64_t next, end;
+
+    pthread_mutex_lock(&victim->lock);
+
+    end = victim->end;
+    next = end - (end - victim->next + 1) / 2;
+
+    if (next < end)
+      victim->end = next;
+
+    pthread_mutex_unlock(&victim->lock);
+
+    if (next < end) {
+      pthread_mutex_lock(&worker->lock);
+      worker->next = next;
+      worker->end = end;
+      worker->steals++;
+      pthread_mutex_unlock(&worker->lock);
+
+      return true;
+    }
+  }
+
+  return false;
+}
+
+
+/**
+ * @brief Body of the threads of the runner.
+ * @param argument The worker.
+ */
+void *run_worker(void *argument) {
+  struct worker *worker = argument;
+  struct runner *runner = worker->runner;
+  uint64_t seed;
+
+  do {
+    while (take_seed(worker, &seed))
+      play_game(runner, &worker->bot, seed, &runner->results[seed - runner->first_seed]);
+  } while (steal_seeds(worker));
+
+  return NULL;
+}
+
+
+/******************************************************************************/
+/* REPORT                                                                     */
+
+int compare_scores(const void *a, const void *b) {
+  int x = *(const int *) a, y = *(const int *) b;
+
+  return (x > y) - (x < y);
+}
+
+
+/**
+ * @brief Prints the aggregate results of the games.
+ * @param runner The runner.
+ * @param games Number of games.
+ * @param seconds Time taken by the games.
+ */
+void print_report(const struct runner *runner, int games, double seconds) {
+  int *scores = malloc(sizeof(int) * (size_t) games);
+  int outcomes[3] = { 0 };
+  long long pills_count = 0, ticks = 0, score = 0, allocations = 0, heap_allocations = 0;
+  struct table_stats table = { 0 };
+  int steals = 0;
+
+  for (int i = 0; i < games; i++) {
+    const struct result *result = &runner->results[i];
+
+    outcomes[result->status]++;
+    pills_count += result->pills_count;
+    ticks += result->ticks;
+    score += result->score;
+    allocations += result->allocations;
+    heap_allocations += result->heap_allocations;
+    add_table_stats(&table, &result->table);
+    if (scores)
+      scores[i] = result->score;
+  }
+
+  for (int i = 0; i < runner->workers_count; i++)
+    steals += runner->workers[i].steals;
+
+  printf("games: %d\n", games);
+  printf("wins: %d\nlosses: %d\nunfinished: %d\n", outcomes[VICTORY], outcomes[DEFEAT], outcomes[RUNNING]);
+  printf("pills: %lld (%.1f per game)\n", pills_count, (double) pills_count / games);
+  printf("ticks: %lld (%.1f per game)\n", ticks, (double) ticks / games);
+  printf("score: mean %.1f", (double) score / games);
+
+  if (scores) {
+    qsort(scores, (size_t) games, sizeof(int), compare_scores);
+    printf(", min %d, p25 %d, median %d, p75 %d, p90 %d, max %d", scores[0], scores[games / 4], scores[games / 2],
+           scores[games * 3 / 4], scores[games * 9 / 10], scores[games - 1]);
+    free(scores);
+  }
+
+  if (runner->policy == SEARCH_POLICY)
+    printf("\nsearch allocations: %lld (%lld from the heap)", allocations, heap_allocations);
+
+  if (runner->policy == SEARCH_POLICY && runner->table_size)
+    printf("\ntransposition table: %lld hits, %lld misses, %lld stores, %lld collisions", table.hits, table.misses,
+           table.stores, table.collisions);
+
+  printf("\nthreads: %d (%d steals)\nseconds: %.3f (%.0f games/s)\n", runner->workers_count, steals, seconds,
+         games / seconds);
+}
+
+
+/**
+ * @brief Writes the result of every game as CSV.
+ * @param runner The runner.
+ * @param games Number of games.
+ * @param path The filepath of the CSV.
+ * @return bool Returns `false` if the file cannot be written.
+ */
+bool write_results(const struct runner *runner, int games, const char *path) {
+  static const char *states[] = { "unfinished", "victory", "defeat" };
+  FILE *fp = fopen(path, "w");
+
+  if (!fp)
+    return false;
+
+  fprintf(fp, "seed,status,score,pills,ticks\n");
+
+  for (int i = 0; i < games; i++) {
+    const struct result *result = &runner->results[i];
+
+    fprintf(fp, "%llu,%s,%d,%d,%d\n", (unsigned long long) (runner->first_seed + (uint64_t) i),
+            states[result->status], result->score, result->pills_count, result->ticks);
+  }
+
+  return fclose(fp) == 0;
+}
+
+
+/******************************************************************************/
+/* MAIN                                                                       */
+
+void usage() {
+  fprintf(stderr, "DR.MAURO - self-play runner\n"
+          "Usage: drmauro_run [-s SEED] [-n GAMES] [-d DIFFICULTY] [-p POLICY] [-f SCRIPT] [-t THREADS]\n"
+          "                   [-l PILLS] [-w WIDTH] [-j THREADS] [-b MS] [-x MB] [-m TICKS] [-o FILE] [-h]\n"
+          "\n"
+          "OPTIONS:\n"
+          "  -s SEED         First seed, the games use consecutive seeds (default 1)\n"
+          "  -n GAMES        Number of games (default 1000)\n"
+          "  -d DIFFICULTY   Difficulty, or a range MIN-MAX spread over the seeds (default 5)\n"
+          "  -p POLICY       random, scripted, bot or search (default bot)\n"
+          "  -f SCRIPT       Commands of the scripted policy: l r d x z . (repeated)\n"
+          "  -t THREADS      Number of threads (default one per core)\n"
+          "  -l PILLS        Pills looked ahead by the search policy (default 2)\n"
+          "  -w WIDTH        Games kept at every level of the search (default 64)\n"
+          "  -j THREADS      Threads of every search, besides the games run in parallel (default 1)\n"
+          "  -b MS           Time budget of every search, 0 for none (default 0)\n"
+          "  -x MB           Size of the transposition table of the search, for every thread of the runner,\n"
+          "                  0 for none (default 0)\n"
+          "  -m TICKS        Ticks after which a game is left unfinished (default 100000)\n"
+          "  -o FILE         Write the result of every game to FILE as CSV\n"
+          "  -h              Show this help message\n"
+          );
+  exit(1);
+}
+
+
+int main(int argc, char **argv) {
+  struct runner runner = { 0 };
+  enum command script[MAX_SCRIPT_LENGTH];
+  const char *script_file = NULL;
+  const char *output_file = NULL;
+  int games = 1000;
+  int threads = (int) sysconf(_SC_NPROCESSORS_ONLN);
+  double table_megabytes = 0;
+  int c;
+
+  runner.first_seed = 1;
+  runner.min_difficulty = runner.max_difficulty = 5;
+  runner.max_ticks = 100000;
+  runner.policy = BOT_POLICY;
+  init_bot(&runner.bot);
+
+  while ((c = getopt(argc, argv, "s:n:d:p:f:t:l:w:j:b:x:m:o:h")) != -1) {
+    switch (c) {
+      case 's': runner.first_seed = strtoull(optarg, NULL, 10); break;
+      case 'n': games = atoi(optarg); break;
+      case 'd':
+        if (sscanf(optarg, "%d-%d", &runner.min_difficulty, &runner.max_difficulty) == 1)
+          runner.max_difficulty = runner.min_difficulty;
+        break;
+      case 'p':
+        if (!strcmp(optarg, "random"))
+          runner.policy = RANDOM_POLICY;
+        else if (!strcmp(optarg, "scripted"))
+          runner.policy = SCRIPTED_POLICY;
+        else if (!strcmp(optarg, "bot"))
+          runner.policy = BOT_POLICY;
+        else if (!strcmp(optarg, "search"))
+          runner.policy = SEARCH_POLICY;
+        else
+          usage();
+        break;
+      case 'f': script_file = optarg; break;
+      case 't': threads = atoi(optarg); break;
+      case 'l': runner.bot.depth = atoi(optarg); break;
+      case 'w': runner.bot.width = atoi(optarg); break;
+      case 'j': runner.bot.threads = atoi(optarg); break;
+      case 'b': runner.bot.time_budget = atof(optarg) / 1000; break;
+      case 'x': table_megabytes = atof(optarg); break;
+      case 'm': runner.max_ticks = atoi(optarg); break;
+      case 'o': output_file = optarg; break;
+      default: usage();
+    }
+  }
+
+  if (optind < argc || games <= 0 || threads <= 0 || runner.min_difficulty < 0 ||
+      runner.max_difficulty > 15 || runner.min_difficulty > runner.max_difficulty || runner.bot.depth <= 0 ||
+      runner.bot.width <= 0 || runner.bot.threads <= 0 || runner.bot.threads > MAX_BOT_THREADS ||
+      runner.bot.time_budget < 0 || table_megabytes < 0)
+    usage();
+
+  runner.table_size = (size_t) (table_megabytes * 1024 * 1024);
+
+  if (runner.policy == SCRIPTED_POLICY) {
+    runner.script_length = script_file ? load_script(script_file, script) : -1;
+
+    if (runner.script_length <= 0) {
+      fprintf(stderr, "The scripted policy needs a valid script, of at most %d commands.\n", MAX_SCRIPT_LENGTH);
+      return EXIT_FAILURE;
+    }
+
+    runner.script = script;
+  }
+
+  if (threads > games)
+    threads = games;
+
+  runner.results = calloc((size_t) games, sizeof(struct result));
+  runner.workers = calloc((size_t) threads, sizeof(struct worker));
+  runner.workers_count = threads;
+
+  if (!runner.results || !runner.workers) {
+    fprintf(stderr, "Out of memory.\n");
+    return EXIT_FAILURE;
+  }
+
+  // The seeds are split evenly at first, then the workers which finish early steal from the others.
+  for (int i = 0; i < threads; i++) {
+    struct worker *worker = &runner.workers[i];
+
+    worker->id = i;
+    worker->runner = &runner;
+    worker->bot = runner.bot;
+
+    if (runner.policy == SEARCH_POLICY && runner.table_size) {
+      if (!init_transposition_table(&worker->table, runner.table_size)) {
+        fprintf(stderr, "Out of memory.\n");
+        return EXIT_FAILURE;
+      }
+
+      worker->bot.table = &worker->table;
+    }
+
+    worker->next = runner.first_seed + (uint64_t) games * (uint64_t) i / (uint64_t) threads;
+    worker->end = runner.first_seed + (uint64_t) games * (uint64_t) (i + 1) / (uint64_t) threads;
+    pthread_mutex_init(&worker->lock, NULL);
+  }
+
+  struct timespec start, end;
+  clock_gettime(CLOCK_MONOTONIC, &start);
+
+  for (int i = 0; i < threads; i++)
+    pthread_create(&runner.workers[i].thread, NULL, run_worker, &runner.workers[i]);
+
+  for (int i = 0; i < threads; i++)
+    pthread_join(runner.workers[i].thread, NULL);
+
+  clock_gettime(CLOCK_MONOTONIC, &end);
+
+  print_report(&runner, games, (double) (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9);
+
+  if (output_file && !write_results(&runner, games, output_file)) {
+    fprintf(stderr, "Cannot write the file.\n");
+    return EXIT_FAILURE;
+  }
+
+  for (int i = 0; i < threads; i++) {
+    pthread_mutex_destroy(&runner.workers[i].lock);
+    free_transposition_table(&runner.workers[i].table);
+  }
+
+  free(runner.workers);
+  free(runner.results);
+
+  return EXIT_SUCCESS;
+}
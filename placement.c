@@ -0,0 +1,530 @@
+#include <string.h>
+
+#include "placement.h"
+
+#define STATES_PER_ORDER (2 * ROWS * COLUMNS)
+
+
+/**
+ * The cells where the first half of the pill can be, for every orientation, given the cells occupied by the board
+ * without the pill itself.
+ *   - `valid`: both halves are on empty cells, or above the grid;
+ *   - `resting`: the pill lands there, being on the last row or above an occupied cell;
+ *   - `open_right`: the cell on the right is empty, so a vertical pill rotates without being pushed to the left.
+ */
+struct pill_masks {
+  bitboard occupied;
+  bitboard valid[2];
+  bitboard resting[2];
+  bitboard open_right;
+};
+
+
+/******************************************************************************/
+/* STATES                                                                     */
+
+/**
+ * @brief Returns the index of a state of the pill.
+ * @param swapped The colors are swapped with respect to the pill the search started from.
+ * @param orientation The orientation.
+ * @param row Row of the first half.
+ * @param column Column of the first half.
+ * @return int
+ */
+int get_pill_state(bool swapped, enum direction orientation, int row, int column) {
+  return (int) swapped * STATES_PER_ORDER + ((int) orientation * ROWS + row) * COLUMNS + column;
+}
+
+
+/**
+ * @brief Builds the masks of the positions of the pill, from the occupancy of the board.
+ * @details The cell of the first half is tested on every mask, so the cells of the second half, on its right or above
+ * it, are shifted onto the first one. The row above the grid is always empty.
+ * @param game Pointer to the game instance.
+ * @param masks The masks.
+ */
+void init_pill_masks(const struct game *game, struct pill_masks *masks) {
+  const struct pill *pill = &game->pill;
+  bitboard occupied = bb_or(bb_or(game->board.color[RED], game->board.color[YELLOW]), game->board.color[BLUE]);
+
+  // The pill is on the board, but it's not an obstacle to itself.
+  if (pill->first_half.row >= 0)
+    bb_reset(&occupied, pill->first_half.row, pill->first_half.column);
+  if (pill->second_half.row >= 0)
+    bb_reset(&occupied, pill->second_half.row, pill->second_half.column);
+
+  bitboard empty = bb_andnot(bb_full(), occupied);
+  bitboard below = bb_or(bb_up(occupied), bb_row(ROWS - 1));
+
+  masks->occupied = occupied;
+  masks->open_right = bb_left(empty);
+  masks->valid[HORIZONTAL] = bb_and(empty, masks->open_right);
+  masks->valid[VERTICAL] = bb_and(empty, bb_or(bb_down(empty), bb_row(0)));
+  masks->resting[HORIZONTAL] = bb_or(below, bb_left(below));
+  masks->resting[VERTICAL] = below;
+}
+
+
+/**
+ * @brief Returns the state where a command brings the pill, following the rules of `rotate_pill()`, `move_pill()` and
+ * `place_pill()`.
+ * @details A vertical pill rotating next to the right wall, or next to an occupied cell, is pushed one column to the
+ * left. `DOWN` brings the pill straight to the row where it lands.
+ * @param masks The masks of the board.
+ * @param state The state of the pill.
+ * @param command The command.
+ * @param flip Rotations swap the colors, namely the pill has two different colors.
+ * @return int The new state, or `-1` when the command fails and the pill stays where it is.
+ */
+int get_next_pill_state(const struct pill_masks *masks, int state, enum command command, bool flip) {
+  bool swapped = state >= STATES_PER_ORDER;
+  enum direction orientation = (enum direction) (state % STATES_PER_ORDER / (ROWS * COLUMNS));
+  int row = state / COLUMNS % ROWS;
+  int column = state % COLUMNS;
+
+  switch (command) {
+    case RIGHT:
+      column++;
+      break;
+
+    case LEFT:
+      column--;
+      break;
+
+    case NONE:
+      row++;
+      break;
+
+    case DOWN: {
+      int landing = bb_next_row(masks->occupied, row, column) - 1;
+
+      if (orientation == HORIZONTAL) {
+        int second_landing = bb_next_row(masks->occupied, row, column + 1) - 1;
+
+        if (second_landing < landing)
+          landing = second_landing;
+      }
+
+      return get_pill_state(swapped, orientation, landing, column);
+    }
+
+    case CLOCKWISE_ROTATION:
+    case ANTICLOCKWISE_ROTATION:
+      if (orientation == HORIZONTAL) {
+        orientation = VERTICAL;
+        swapped ^= flip && command == CLOCKWISE_ROTATION;
+      } else {
+        orientation = HORIZONTAL;
+        swapped ^= flip && command == ANTICLOCKWISE_ROTATION;
+
+        if (!bb_test(masks->open_right, row, column))
+          column--;
+      }
+      break;
+
+    default:
+      return -1;
+  }
+
+  if (row >= ROWS || column < 0 || column >= COLUMNS || !bb_test(masks->valid[orientation], row, column))
+    return -1;
+
+  return get_pill_state(swapped, orientation, row, column);
+}
+
+
+/******************************************************************************/
+/* SEARCH                                                                     */
+
+/**
+ * @brief Finds every place where the active pill can land, with the shortest sequence of commands for each.
+ * @details A breadth-first search over the states of the pill, one tick per level, on masks of the board instead of
+ * copies of the game. Every command which moves the pill where it rests lands it, so the resting states are the leaves
+ * of the search and only the others are expanded. A pill of a single color has no swapped states.
+ * @param game Pointer to the game instance, with an active pill.
+ * @param placements The placements found.
+ * @return int The number of placements, 0 when there is no active pill in the grid.
+ */
+int find_placements(const struct game *game, struct placements *placements) {
+  static const enum command commands[] = {
+    DOWN, LEFT, RIGHT, CLOCKWISE_ROTATION, ANTICLOCKWISE_ROTATION, NONE
+  };
+  const struct pill *pill = &game->pill;
+  struct pill_masks masks;
+  int16_t queue[PILL_STATES];
+  int head = 0, tail = 0;
+
+  placements->count = 0;
+
+  if (!pill->active || pill->first_half.row < 0)
+    return 0;
+
+  init_pill_masks(game, &masks);
+
+  bool flip = pill->first_half.color != pill->second_half.color;
+  int start = get_pill_state(false, pill->orientation, pill->first_half.row, pill->first_half.column);
+
+  memset(placements->ticks, 0xff, sizeof(placements->ticks));
+  placements->ticks[start] = 0;
+  placements->parent[start] = -1;
+  queue[tail++] = (int16_t) start;
+
+  while (head < tail) {
+    int state = queue[head++];
+
+    for (int i = 0; i < (int) (sizeof(commands) / sizeof(commands[0])); i++) {
+      int next = get_next_pill_state(&masks, state, commands[i], flip);
+
+      if (next < 0 || placements->ticks[next] >= 0)
+        continue;
+
+      placements->ticks[next] = (int16_t) (placements->ticks[state] + 1);
+      placements->parent[next] = (int16_t) state;
+      placements->command[next] = (uint8_t) commands[i];
+
+      enum direction orientation = (enum direction) (next % STATES_PER_ORDER / (ROWS * COLUMNS));
+      int row = next / COLUMNS % ROWS;
+      int column = next % COLUMNS;
+
+      if (!bb_test(masks.resting[orientation], row, column)) {
+        queue[tail++] = (int16_t) next;
+        continue;
+      }
+
+      struct placement *placement = &placements->placement[placements->count++];
+
+      placement->row = row;
+      placement->column = column;
+      placement->orientation = orientation;
+      placement->colors_swapped = next >= STATES_PER_ORDER;
+      placement->ticks = placements->ticks[next];
+      placement->state = next;
+    }
+  }
+
+  return placements->count;
+}
+
+
+/**
+ * @brief Writes the shortest sequence of commands which lands the pill on a placement, walking back the search.
+ * @param placements The placements found by `find_placements()`.
+ * @param index Index of the placement.
+ * @param commands Where the commands are written, at least `ticks` of the placement long.
+ * @return int The number of commands.
+ */
+int get_placement_commands(const struct placements *placements, int index, enum command *commands) {
+  int state = placements->placement[index].state;
+  int count = placements->ticks[state];
+
+  for (int i = count - 1; i >= 0; i--) {
+    commands[i] = (enum command) placements->command[state];
+    state = placements->parent[state];
+  }
+
+  return count;
+}
+
+
+/******************************************************************************/
+/* REACHABILITY                                                               */
+
+/**
+ * @brief Moves whole sets of states of the pill by every command but `DOWN`, whose landings are also reached by falling
+ * one row at a time. The sets are indexed by orientation and color order, and the cells are the first halves.
+ * @param masks The masks of the board.
+ * @param from The states.
+ * @param to Where the states can be after a command, still to be masked with the valid positions.
+ * @param flip Rotations swap the colors, namely the pill has two different colors.
+ */
+void move_pill_states(const struct pill_masks *masks, bitboard from[2][2], bitboard to[2][2], bool flip) {
+  for (int o = HORIZONTAL; o <= VERTICAL; o++) {
+    for (int s = 0; s < 2; s++)
+      to[o][s] = bb_or(bb_or(bb_left(from[o][s]), bb_right(from[o][s])), bb_down(from[o][s]));
+  }
+
+  for (int s = 0; s < 2; s++) {
+    // The halves of a horizontal pill rotate around the first one.
+    bitboard horizontal = from[HORIZONTAL][s];
+
+    to[VERTICAL][s ^ flip] = bb_or(to[VERTICAL][s ^ flip], horizontal);
+    to[VERTICAL][s] = bb_or(to[VERTICAL][s], horizontal);
+
+    // A vertical pill is pushed to the left when the cell on its right is taken.
+    bitboard rotated = bb_or(bb_and(from[VERTICAL][s], masks->open_right),
+                             bb_left(bb_andnot(from[VERTICAL][s], masks->open_right)));
+
+    to[HORIZONTAL][s] = bb_or(to[HORIZONTAL][s], rotated);
+    to[HORIZONTAL][s ^ flip] = bb_or(to[HORIZONTAL][s ^ flip], rotated);
+  }
+}
+
+
+/**
+ * @brief Finds where the active pill can land, as sets of cells of its first half, without the commands to get there.
+ * @details The states where the pill keeps falling are flooded from the current one, all of them at once by shifting
+ * the masks, until no new state is reached; the landings are one command away from them. It's much faster than
+ * `find_placements()`, and it finds the same placements.
+ * @param game Pointer to the game instance, with an active pill.
+ * @param landings The landings, by orientation and by color order: `landings[VERTICAL][true]` are the cells where the
+ * pill lands vertically with its colors swapped.
+ * @return bool Returns `false` when there is no active pill in the grid.
+ */
+bool find_landings(const struct game *game, bitboard landings[2][2]) {
+  const struct pill *pill = &game->pill;
+  struct pill_masks masks;
+  bitboard falling[2][2] = { { bb_zero(), bb_zero() }, { bb_zero(), bb_zero() } };
+  bitboard moved[2][2];
+  bitboard open[2];
+
+  if (!pill->active || pill->first_half.row < 0) {
+    landings[HORIZONTAL][0] = landings[HORIZONTAL][1] = landings[VERTICAL][0] = landings[VERTICAL][1] = bb_zero();
+    return false;
+  }
+
+  init_pill_masks(game, &masks);
+
+  bool flip = pill->first_half.color != pill->second_half.color;
+
+  for (int o = HORIZONTAL; o <= VERTICAL; o++)
+    open[o] = bb_andnot(masks.valid[o], masks.resting[o]);
+
+  bb_set(&falling[pill->orientation][0], pill->first_half.row, pill->first_half.column);
+
+  for (bool grown = true; grown;) {
+    grown = false;
+    move_pill_states(&masks, falling, moved, flip);
+
+    for (int o = HORIZONTAL; o <= VERTICAL; o++) {
+      for (int s = 0; s < 2; s++) {
+        bitboard states = bb_or(falling[o][s], bb_and(moved[o][s], open[o]));
+
+        grown |= !bb_equal(states, falling[o][s]);
+        falling[o][s] = states;
+      }
+    }
+  }
+
+  move_pill_states(&masks, falling, moved, flip);
+
+  for (int o = HORIZONTAL; o <= VERTICAL; o++) {
+    for (int s = 0; s < 2; s++)
+      landings[o][s] = bb_and(moved[o][s], bb_and(masks.valid[o], masks.resting[o]));
+  }
+
+  return true;
+}
+
+
+/******************************************************************************/
+/* LANDING                                                                    */
+
+/**
+ * @brief Lands the active pill on a placement at once, as the last of its commands would, then processes the grid.
+ * @details The pill only moves between the ticks before landing, so the game ends up as if all the commands of the
+ * placement had been executed.
+ * @param game Pointer to the game instance.
+ * @param placement A placement found by `find_placements()` for the current pill.
+ */
+void land_placement(struct game *game, const struct placement *placement) {
+  struct pill *pill = &game->moving_pill;
+
+  *pill = game->pill;
+
+  if (placement->colors_swapped) {
+    pill->first_half.color = game->pill.second_half.color;
+    pill->second_half.color = game->pill.first_half.color;
+  }
+
+  pill->orientation = placement->orientation;
+  pill->first_half.row = placement->row;
+  pill->first_half.column = placement->column;
+  pill->second_half.row = placement->orientation == HORIZONTAL ? placement->row : placement->row - 1;
+  pill->second_half.column = placement->orientation == HORIZONTAL ? placement->column + 1 : placement->column;
+
+  refresh_grid(game);
+}
+
+
+/**
+ * @brief Lands the active pill in a column, with an orientation and a color order, skipping the ticks it would take.
+ * @details The placement must be reachable by the commands. When the pill can land at more rows of the same column,
+ * sliding under something, the highest one is taken, which is where it would be dropped.
+ * @param game Pointer to the game instance.
+ * @param column Column of the first half: the left one when horizontal, the bottom one when vertical.
+ * @param orientation The orientation.
+ * @param colors_swapped The colors are swapped with respect to the active pill.
+ * @return bool Returns `false` if the column or the orientation are out of range, there is no active pill or it cannot
+ * land there, in which case nothing changes.
+ */
+bool execute_placement(struct game *game, int column, enum direction orientation, bool colors_swapped) {
+  bitboard landings[2][2];
+
+  // The column and the orientation come from the caller, and index the landings: they are checked as the moves are.
+  if (column < 0 || column > COLUMNS - 1 || (int) orientation < HORIZONTAL || (int) orientation > VERTICAL)
+    return false;
+
+  if (!find_landings(game, landings))
+    return false;
+
+  // A pill of a single color has no swapped placements, but they are the same as the others.
+  if (game->pill.first_half.color == game->pill.second_half.color)
+    colors_swapped = false;
+
+  int row = bb_next_row(landings[orientation][colors_swapped], -1, column);
+
+  if (row == ROWS)
+    return false;
+
+  struct placement placement = { row, column, orientation, colors_swapped, 0, -1 };
+
+  land_placement(game, &placement);
+
+  return true;
+}
+
+
+/******************************************************************************/
+/* SYMMETRY                                                                   */
+
+/**
+ * @brief Reflects a game left to right, the grid and the active pill, which keeps its orientation. A horizontal pill
+ * swaps its colors, since its halves swap sides. The generator is left as it is.
+ * @details The rules which clear and drop the cells are symmetric, the spawn of the pills and the rotations are not:
+ * the mirror is a game of its own, see `is_mirror_symmetric()`. The pills to come spawn horizontal, so in the mirrored
+ * world they would have their colors swapped, which the generator left as it is does not do: its hash is made by
+ * `get_canonical_hash()`.
+ * @param game Pointer to the game instance.
+ * @param mirror Receives the mirrored game, which may be `game` itself.
+ */
+void mirror_game(const struct game *game, struct game *mirror) {
+  const struct pill *pill = &game->pill;
+  struct pill mirror_pill = *pill;
+
+  if (mirror != game)
+    *mirror = *game;
+
+  for (int color = RED; color < BLANK; color++)
+    mirror->board.color[color] = bb_mirror(game->board.color[color]);
+
+  // A horizontal link belongs to the left half, which is now the one on the other side of the pill.
+  mirror->board.virus = bb_mirror(game->board.virus);
+  mirror->board.link[HORIZONTAL] = bb_left(bb_mirror(game->board.link[HORIZONTAL]));
+  mirror->board.link[VERTICAL] = bb_mirror(game->board.link[VERTICAL]);
+  mirror->changed_cells = bb_mirror(game->changed_cells);
+
+  if (pill->orientation == HORIZONTAL) {
+    mirror_pill.first_half.column = COLUMNS - 1 - pill->second_half.column;
+    mirror_pill.first_half.color = pill->second_half.color;
+    mirror_pill.second_half.column = COLUMNS - 1 - pill->first_half.column;
+    mirror_pill.second_half.color = pill->first_half.color;
+  } else {
+    mirror_pill.first_half.column = COLUMNS - 1 - pill->first_half.column;
+    mirror_pill.second_half.column = COLUMNS - 1 - pill->second_half.column;
+  }
+
+  mirror->pill = mirror_pill;
+  mirror->moving_pill = mirror_pill;
+  mirror->hash = compute_hash(mirror);
+}
+
+
+/**
+ * @brief Tells whether the colors of a placement are swapped with respect to the pill of the mirrored game.
+ * @details The pill of the mirror keeps the colors of a vertical pill and swaps the ones of a horizontal pill, so a
+ * placement in the other orientation changes its color order.
+ * @param game Pointer to the game instance.
+ * @param orientation The orientation of the placement.
+ * @param colors_swapped The colors of the placement are swapped with respect to the pill of the game.
+ * @return bool
+ */
+bool get_mirror_colors_swapped(const struct game *game, enum direction orientation, bool colors_swapped) {
+  const struct pill *pill = &game->pill;
+
+  return colors_swapped ^ (orientation != pill->orientation && pill->first_half.color != pill->second_half.color);
+}
+
+
+/**
+ * @brief Turns a placement of the pill of a game into the same placement, reflected, of the pill of the mirrored game,
+ * and the other way round, since the pills of a game and of its mirror have the same orientation and colors.
+ * @details The ticks are left as they are: they are the same only when `is_mirror_symmetric()` holds, and even then
+ * the commands are not just the reflected ones.
+ * @param game Pointer to the game instance, or to the mirrored one.
+ * @param placement The placement, which is reflected in place.
+ */
+void mirror_placement(const struct game *game, struct placement *placement) {
+  placement->column = COLUMNS - 1 - placement->column - (placement->orientation == HORIZONTAL);
+  placement->colors_swapped = get_mirror_colors_swapped(game, placement->orientation, placement->colors_swapped);
+  placement->state = get_pill_state(placement->colors_swapped, placement->orientation, placement->row,
+                                    placement->column);
+}
+
+
+/**
+ * @brief Tells whether a game and its mirror are the same game, reflected: the grids are, and the active pill can
+ * land on the reflection of every placement, and nowhere else, so that the values of both are the same.
+ * @details It's false where the pill cannot reach a place because it needs a rotation, which kicks the pill to the
+ * left, or the room the spawn position leaves on one side only. The pills to come are not looked at: they may break
+ * the symmetry again, on the grids to come, so a search checks it for every game.
+ * @param game Pointer to the game instance, with an active pill in the grid.
+ * @param mirror Pointer to the mirrored game, as made by `mirror_game()`.
+ * @return bool
+ */
+bool is_mirror_symmetric(const struct game *game, const struct game *mirror) {
+  bitboard landings[2][2], mirror_landings[2][2];
+
+  if (!find_landings(game, landings) || !find_landings(mirror, mirror_landings))
+    return false;
+
+  for (int o = HORIZONTAL; o <= VERTICAL; o++) {
+    for (int s = 0; s < 2; s++) {
+      bitboard reflected = bb_mirror(landings[o][s]);
+
+      // The first half of a horizontal pill is the left one, on both sides.
+      if (o == HORIZONTAL)
+        reflected = bb_left(reflected);
+
+      if (!bb_equal(reflected, mirror_landings[o][get_mirror_colors_swapped(game, (enum direction) o, s)]))
+        return false;
+    }
+  }
+
+  return true;
+}
+
+
+/**
+ * @brief Returns the same hash as `game_hash()` for a game and for its mirror, when they are the same game reflected,
+ * the lower of both; otherwise the hash of the game.
+ * @details The hash of the mirror takes the next pill with its colors swapped, as it spawns in the mirrored world, so
+ * a game only shares its hash with the reflection of a game which has the same next pill, reflected. Both color orders
+ * of a pill can be reached from the spawn position, so they land on the same places. The pills after the next one are
+ * not in the hash, as in `game_hash()`. When the hash is the one of the mirror, so are the placements stored with it
+ * in a transposition table: `mirror_placement()` turns them into placements of the game.
+ * @param game Pointer to the game instance.
+ * @param mirrored Receives whether the hash is the one of the mirror, unless `NULL`.
+ * @return uint64_t
+ */
+uint64_t get_canonical_hash(const struct game *game, bool *mirrored) {
+  uint64_t hash = game_hash(game);
+  struct game mirror;
+
+  if (mirrored)
+    *mirrored = false;
+
+  if (!game->pill.active || game->pill.first_half.row < 0)
+    return hash;
+
+  mirror_game(game, &mirror);
+
+  uint64_t mirror_hash = mirror.hash ^ get_next_pill_hash(&mirror, true);
+
+  if (mirror_hash >= hash || !is_mirror_symmetric(game, &mirror))
+    return hash;
+
+  if (mirrored)
+    *mirrored = true;
+
+  return mirror_hash;
+}
@@ -0,0 +1,49 @@
+#ifndef PLACEMENT_H
+#define PLACEMENT_H
+
+#include <stdint.h>
+
+#include "drmauro.h"
+
+#define PILL_STATES (2 * 2 * ROWS * COLUMNS)
+#define MAX_PLACEMENTS PILL_STATES
+
+
+/**
+ * Where the active pill can land: the position of its first half, the left one when horizontal and the bottom one when
+ * vertical, its orientation, and whether its colors are swapped with respect to the pill as it is now. `ticks` is the
+ * length of the shortest sequence of commands which lands it there, the last one included.
+ */
+struct placement {
+  int row;
+  int column;
+  enum direction orientation;
+  bool colors_swapped;
+  int ticks;
+  int state;
+};
+
+/**
+ * The placements of the active pill, found by `find_placements()` in order of ticks, and the tree of the search which
+ * gives back their commands. The states of the pill are indexed by color order, orientation, row and column.
+ */
+struct placements {
+  int count;
+  struct placement placement[MAX_PLACEMENTS];
+  int16_t ticks[PILL_STATES];
+  int16_t parent[PILL_STATES];
+  uint8_t command[PILL_STATES];
+};
+
+
+int find_placements(const struct game *game, struct placements *placements);
+int get_placement_commands(const struct placements *placements, int index, enum command *commands);
+bool find_landings(const struct game *game, bitboard landings[2][2]);
+void land_placement(struct game *game, const struct placement *placement);
+bool execute_placement(struct game *game, int column, enum direction orientation, bool colors_swapped);
+void mirror_game(const struct game *game, struct game *mirror);
+void mirror_placement(const struct game *game, struct placement *placement);
+bool is_mirror_symmetric(const struct game *game, const struct game *mirror);
+uint64_t get_canonical_hash(const struct game *game, bool *mirrored);
+
+#endif
@@ -0,0 +1,904 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+
+#include "replay.h"
+
+#define BOARD_FILE 0xff
+#define RUN_BITS 5
+#define MAX_SHORT_RUN ((1 << RUN_BITS) - 1)
+#define MARKER_MASK 0x07
+#define MAX_BOARD_SIZE 4096
+#define VARINT_MAX_SIZE 10
+#define TRAILER_SIZE 8
+
+
+/******************************************************************************/
+/* ENCODING                                                                   */
+
+/**
+ * @brief Writes an unsigned integer as a varint: 7 bits per byte, the lowest first, with the high bit set on all the
+ * bytes but the last.
+ * @param buffer Where the varint is written, at least `VARINT_MAX_SIZE` bytes long.
+ * @param value The integer.
+ * @return uint8_t* The end of the varint.
+ */
+uint8_t *put_varint(uint8_t *buffer, uint64_t value) {
+  while (value >= 0x80) {
+    *buffer++ = (uint8_t) (value & 0x7f) | 0x80;
+    value >>= 7;
+  }
+
+  *buffer++ = (uint8_t) value;
+
+  return buffer;
+}
+
+
+/**
+ * @brief Reads a varint written by `put_varint()`.
+ * @param data The replay.
+ * @param size Size of the replay.
+ * @param offset Offset of the varint, moved past it.
+ * @param value Where the integer is written.
+ * @return bool Returns `false` when the varint is truncated or too long.
+ */
+bool read_varint(const uint8_t *data, size_t size, size_t *offset, uint64_t *value) {
+  *value = 0;
+
+  for (int shift = 0; shift < 64; shift += 7) {
+    if (*offset >= size)
+      return false;
+
+    uint8_t byte = data[(*offset)++];
+    *value |= (uint64_t) (byte & 0x7f) << shift;
+
+    if (!(byte & 0x80))
+      return true;
+  }
+
+  return false;
+}
+
+
+/**
+ * @brief Reads a varint which must fit in an `int`.
+ * @param data The replay.
+ * @param size Size of the replay.
+ * @param offset Offset of the varint, moved past it.
+ * @param value Where the integer is written.
+ * @return bool Returns `false` when the varint is not valid or too large.
+ */
+bool read_int(const uint8_t *data, size_t size, size_t *offset, int *value) {
+  uint64_t number;
+
+  if (!read_varint(data, size, offset, &number) || number > INT_MAX)
+    return false;
+
+  *value = (int) number;
+
+  return true;
+}
+
+
+/**
+ * @brief Writes a bitboard: a byte with a bit for every column which is not empty, then those columns, 2 bytes each.
+ * Most of the sets of a game, like the links, are almost empty.
+ * @param buffer Where the bitboard is written.
+ * @param bb The bitboard.
+ * @return uint8_t* The end of the bitboard.
+ */
+uint8_t *put_bitboard(uint8_t *buffer, bitboard bb) {
+  uint8_t *mask = buffer++;
+
+  *mask = 0;
+
+  for (int c = 0; c < COLUMNS; c++) {
+    if (bb.column[c]) {
+      *mask |= (uint8_t) (1 << c);
+      *buffer++ = (uint8_t) (bb.column[c] & 0xff);
+      *buffer++ = (uint8_t) (bb.column[c] >> 8);
+    }
+  }
+
+  return buffer;
+}
+
+
+/**
+ * @brief Reads a bitboard written by `put_bitboard()`.
+ * @param data The replay.
+ * @param size Size of the replay.
+ * @param offset Offset of the bitboard, moved past it.
+ * @param bb Where the bitboard is written.
+ * @return bool Returns `false` when the bitboard is truncated.
+ */
+bool read_bitboard(const uint8_t *data, size_t size, size_t *offset, bitboard *bb) {
+  if (*offset >= size)
+    return false;
+
+  uint8_t mask = data[(*offset)++];
+
+  *bb = bb_zero();
+
+  for (int c = 0; c < COLUMNS; c++) {
+    if (mask & (1 << c)) {
+      if (size - *offset < 2)
+        return false;
+
+      bb->column[c] = (uint16_t) (data[*offset] | data[*offset + 1] << 8);
+      *offset += 2;
+    }
+  }
+
+  return true;
+}
+
+
+/**
+ * @brief Writes a pill: the orientation, whether it's active, then the row, column and color of both halves, one byte
+ * each.
+ * @param buffer Where the pill is written.
+ * @param pill The pill.
+ * @return uint8_t* The end of the pill.
+ */
+uint8_t *put_pill(uint8_t *buffer, const struct pill *pill) {
+  const struct halve *halves[] = { &pill->first_half, &pill->second_half };
+
+  *buffer++ = (uint8_t) pill->orientation;
+  *buffer++ = (uint8_t) pill->active;
+
+  for (int i = 0; i < 2; i++) {
+    // Rows can be negative while the pill rotates at the top of the grid.
+    *buffer++ = (uint8_t) (int8_t) halves[i]->row;
+    *buffer++ = (uint8_t) (int8_t) halves[i]->column;
+    *buffer++ = (uint8_t) halves[i]->color;
+  }
+
+  return buffer;
+}
+
+
+/**
+ * @brief Reads a pill written by `put_pill()`.
+ * @param data The replay.
+ * @param size Size of the replay.
+ * @param offset Offset of the pill, moved past it.
+ * @param pill Where the pill is written.
+ * @return bool Returns `false` when the pill is truncated or not valid.
+ */
+bool read_pill(const uint8_t *data, size_t size, size_t *offset, struct pill *pill) {
+  struct halve *halves[] = { &pill->first_half, &pill->second_half };
+
+  if (size - *offset < 8 || data[*offset] > VERTICAL || data[*offset + 1] > 1)
+    return false;
+
+  pill->orientation = (enum direction) data[(*offset)++];
+  pill->active = data[(*offset)++];
+
+  for (int i = 0; i < 2; i++) {
+    halves[i]->row = (int8_t) data[(*offset)++];
+    halves[i]->column = (int8_t) data[(*offset)++];
+
+    if (data[*offset] >= BLANK)
+      return false;
+
+    halves[i]->color = (enum color) data[(*offset)++];
+  }
+
+  return true;
+}
+
+
+/**
+ * @brief Tells whether a pill read from a keyframe can be played: its halves are within the rows a pill can reach,
+ * above the grid included, and within the columns, and the halves of an active pill are next to each other as its
+ * orientation requires.
+ * @param pill The pill.
+ * @param margin Cells the pill may stick out of the grid on every side: the moving pill keeps the last move tried,
+ * even when it was refused for leaving the grid.
+ * @return bool
+ */
+bool is_valid_pill(const struct pill *pill, int margin) {
+  const struct halve *halves[] = { &pill->first_half, &pill->second_half };
+
+  for (int i = 0; i < 2; i++) {
+    if (halves[i]->row < -PILL_ROW_OFFSET - margin || halves[i]->row >= ROWS + margin ||
+        halves[i]->column < -margin || halves[i]->column >= COLUMNS + margin)
+      return false;
+  }
+
+  if (!pill->active)
+    return true;
+
+  if (pill->orientation == HORIZONTAL)
+    return pill->second_half.row == pill->first_half.row && pill->second_half.column == pill->first_half.column + 1;
+
+  return pill->second_half.row == pill->first_half.row - 1 && pill->second_half.column == pill->first_half.column;
+}
+
+
+/**
+ * @brief Tells whether a board read from a keyframe can be played: a cell has a single color, the viruses and the
+ * links are on taken cells, a link joins a cell to another taken cell, and the viruses are as many as counted.
+ * @param board The board.
+ * @param virus_count The count of the viruses of the game.
+ * @return bool
+ */
+bool is_valid_board(const struct board *board, int virus_count) {
+  bitboard occupied = bb_zero();
+
+  for (int i = 0; i < BLANK; i++) {
+    if (bb_any(bb_and(occupied, board->color[i])))
+      return false;
+
+    occupied = bb_or(occupied, board->color[i]);
+  }
+
+  // A horizontal link is on the left half, a vertical one on the top half.
+  bitboard linkable[2] = { bb_and(occupied, bb_left(occupied)), bb_and(occupied, bb_up(occupied)) };
+
+  return bb_equal(bb_and(board->virus, occupied), board->virus) &&
+         bb_equal(bb_and(board->link[HORIZONTAL], linkable[HORIZONTAL]), board->link[HORIZONTAL]) &&
+         bb_equal(bb_and(board->link[VERTICAL], linkable[VERTICAL]), board->link[VERTICAL]) &&
+         bb_count(board->virus) == virus_count;
+}
+
+
+/**
+ * @brief Writes the state of a game, all but its logger, as compact as it's practical.
+ * @param game Pointer to the game instance.
+ * @param buffer Where the state is written, at least `KEYFRAME_MAX_SIZE` bytes long.
+ * @return size_t The size of the state.
+ */
+size_t encode_keyframe(const struct game *game, uint8_t *buffer) {
+  uint8_t *p = buffer;
+
+  for (int i = 0; i < BLANK; i++)
+    p = put_bitboard(p, game->board.color[i]);
+
+  p = put_bitboard(p, game->board.virus);
+  p = put_bitboard(p, game->board.link[HORIZONTAL]);
+  p = put_bitboard(p, game->board.link[VERTICAL]);
+  p = put_bitboard(p, game->changed_cells);
+  p = put_pill(p, &game->pill);
+  p = put_pill(p, &game->moving_pill);
+  p = put_varint(p, (uint64_t) game->pills_count);
+  p = put_varint(p, (uint64_t) game->virus_count);
+  p = put_varint(p, (uint64_t) game->score);
+  p = put_varint(p, (uint64_t) game->points_multiplier);
+  *p++ = (uint8_t) game->status;
+
+  for (int i = 0; i < 4; i++)
+    for (int j = 0; j < 4; j++)
+      *p++ = (uint8_t) (game->rng.state[i] >> (8 * j));
+
+  // Only the statistics of the last cascade are kept, which are empty on most ticks.
+  p = put_varint(p, (uint64_t) game->cascade.steps);
+
+  for (int i = 0; i < game->cascade.steps; i++) {
+    p = put_varint(p, (uint64_t) game->cascade.cleared[i]);
+    p = put_varint(p, (uint64_t) game->cascade.score[i]);
+  }
+
+  return (size_t) (p - buffer);
+}
+
+
+/**
+ * @brief Reads the state of a game written by `encode_keyframe()`.
+ * @param data The replay.
+ * @param size Size of the replay.
+ * @param offset Offset of the state, moved past it.
+ * @param game Pointer to the game instance, whose logger is left untouched.
+ * @return bool Returns `false` when the state is truncated or not valid, as told by `is_valid_pill()` and
+ * `is_valid_board()`.
+ */
+bool decode_keyframe(const uint8_t *data, size_t size, size_t *offset, struct game *game) {
+  bool valid = true;
+
+  for (int i = 0; i < BLANK; i++)
+    valid = valid && read_bitboard(data, size, offset, &game->board.color[i]);
+
+  valid = valid && read_bitboard(data, size, offset, &game->board.virus) &&
+          read_bitboard(data, size, offset, &game->board.link[HORIZONTAL]) &&
+          read_bitboard(data, size, offset, &game->board.link[VERTICAL]) &&
+          read_bitboard(data, size, offset, &game->changed_cells) &&
+          read_pill(data, size, offset, &game->pill) &&
+          read_pill(data, size, offset, &game->moving_pill) &&
+          read_int(data, size, offset, &game->pills_count) &&
+          read_int(data, size, offset, &game->virus_count) &&
+          read_int(data, size, offset, &game->score) &&
+          read_int(data, size, offset, &game->points_multiplier);
+
+  if (!valid || size - *offset < 17 || data[*offset] > DEFEAT)
+    return false;
+
+  game->status = (enum state) data[(*offset)++];
+
+  for (int i = 0; i < 4; i++) {
+    game->rng.state[i] = 0;
+
+    for (int j = 0; j < 4; j++)
+      game->rng.state[i] |= (uint32_t) data[(*offset)++] << (8 * j);
+  }
+
+  if (!read_int(data, size, offset, &game->cascade.steps) || game->cascade.steps > MAX_CASCADE_STEPS)
+    return false;
+
+  for (int i = 0; i < game->cascade.steps; i++) {
+    if (!read_int(data, size, offset, &game->cascade.cleared[i]) ||
+        !read_int(data, size, offset, &game->cascade.score[i]))
+      return false;
+  }
+
+  // The game is played on from the keyframe, so it must not lead the engine out of the grid.
+  if (!is_valid_pill(&game->pill, 0) || !is_valid_pill(&game->moving_pill, 1) ||
+      !is_valid_board(&game->board, game->virus_count))
+    return false;
+
+  // The hash is a function of the board and the pill, so it's not stored.
+  game->hash = compute_hash(game);
+
+  return true;
+}
+
+
+/******************************************************************************/
+/* RECORDING                                                                  */
+
+/**
+ * @brief Writes bytes to the replay, keeping track of the offset.
+ * @param recorder The recorder.
+ * @param data The bytes.
+ * @param size Number of bytes.
+ */
+void put_bytes(struct replay_recorder *recorder, const void *data, size_t size) {
+  if (fwrite(data, 1, size, recorder->fp) != size)
+    recorder->failed = true;
+
+  recorder->offset += size;
+}
+
+
+/**
+ * @brief Writes a varint to the replay.
+ * @param recorder The recorder.
+ * @param value The integer.
+ */
+void write_varint(struct replay_recorder *recorder, uint64_t value) {
+  uint8_t buffer[VARINT_MAX_SIZE];
+
+  put_bytes(recorder, buffer, (size_t) (put_varint(buffer, value) - buffer));
+}
+
+
+/**
+ * @brief Writes the run of commands being recorded, if any.
+ * @param recorder The recorder.
+ */
+void flush_run(struct replay_recorder *recorder) {
+  if (recorder->run == 0)
+    return;
+
+  uint8_t buffer[1 + VARINT_MAX_SIZE], *p = buffer;
+  long long length = recorder->run - 1;
+
+  if (length < MAX_SHORT_RUN) {
+    *p++ = (uint8_t) (recorder->command | length << 3);
+  } else {
+    *p++ = (uint8_t) (recorder->command | MAX_SHORT_RUN << 3);
+    p = put_varint(p, (uint64_t) (length - MAX_SHORT_RUN));
+  }
+
+  put_bytes(recorder, buffer, (size_t) (p - buffer));
+  recorder->run = 0;
+}
+
+
+/**
+ * @brief Writes a keyframe with the state of the game, and adds it to the index.
+ * @param recorder The recorder.
+ * @param game Pointer to the game instance.
+ */
+void write_keyframe(struct replay_recorder *recorder, const struct game *game) {
+  if (recorder->keyframes_count == recorder->keyframes_capacity) {
+    size_t capacity = recorder->keyframes_capacity ? 2 * recorder->keyframes_capacity : 64;
+    struct keyframe *keyframes = realloc(recorder->keyframes, capacity * sizeof(struct keyframe));
+
+    // Without the index the keyframe could not be found, so it's better not to write it.
+    if (!keyframes) {
+      recorder->failed = true;
+      return;
+    }
+
+    recorder->keyframes = keyframes;
+    recorder->keyframes_capacity = capacity;
+  }
+
+  recorder->keyframes[recorder->keyframes_count++] = (struct keyframe) { recorder->ticks, recorder->offset };
+
+  uint8_t buffer[1 + KEYFRAME_MAX_SIZE];
+
+  buffer[0] = REPLAY_KEYFRAME;
+  put_bytes(recorder, buffer, 1 + encode_keyframe(game, buffer + 1));
+}
+
+
+/**
+ * @brief Creates a replay and writes its header. The game must have been initialized with the same seed, and its grid
+ * filled with the same difficulty or loaded from the same file, right before.
+ * @param recorder The recorder.
+ * @param path The filepath of the replay.
+ * @param seed The seed passed to `init_game()`.
+ * @param difficulty The difficulty passed to `fill_grid()`, ignored when `board_file` is given.
+ * @param board_file The file passed to `load_grid()`, or `NULL`. Its content is copied in the replay.
+ * @param keyframe_interval Ticks between two keyframes, 0 for none. Shorter intervals make seeking faster and the
+ * replay bigger.
+ * @return error `NO_ERROR`, or the reason why the replay could not be created.
+ */
+enum error replay_create(struct replay_recorder *recorder, const char *path, uint64_t seed, int difficulty,
+                         const char *board_file, int keyframe_interval) {
+  char board[MAX_BOARD_SIZE];
+  size_t board_size = 0;
+
+  memset(recorder, 0, sizeof(struct replay_recorder));
+  recorder->keyframe_interval = keyframe_interval;
+
+  if (board_file) {
+    FILE *fp = fopen(board_file, "rb");
+
+    if (!fp)
+      return CANNOT_OPEN_FILE;
+
+    board_size = fread(board, 1, sizeof(board), fp);
+
+    // A layout is a few hundred bytes: a longer file is certainly not one.
+    bool too_long = fgetc(fp) != EOF;
+    fclose(fp);
+
+    if (too_long)
+      return BOARD_FILE_TOO_LARGE;
+  }
+
+  recorder->fp = fopen(path, "wb");
+
+  if (!recorder->fp)
+    return CANNOT_WRITE_FILE;
+
+  uint8_t header[] = { REPLAY_VERSION, board_file ? BOARD_FILE : (uint8_t) difficulty };
+
+  put_bytes(recorder, REPLAY_MAGIC, strlen(REPLAY_MAGIC));
+  put_bytes(recorder, header, sizeof(header));
+
+  if (board_file) {
+    write_varint(recorder, board_size);
+    put_bytes(recorder, board, board_size);
+  }
+
+  uint8_t bytes[8];
+
+  for (int i = 0; i < 8; i++)
+    bytes[i] = (uint8_t) (seed >> (8 * i));
+
+  put_bytes(recorder, bytes, sizeof(bytes));
+
+  return NO_ERROR;
+}
+
+
+/**
+ * @brief Records the command passed to `execute()` at a tick, and the keyframe when it's due.
+ * @param recorder The recorder.
+ * @param game Pointer to the game instance, after the command was executed.
+ * @param command The command.
+ */
+void replay_record(struct replay_recorder *recorder, const struct game *game, enum command command) {
+  if (recorder->run > 0 && command != recorder->command)
+    flush_run(recorder);
+
+  recorder->command = command;
+  recorder->run++;
+  recorder->ticks++;
+
+  if (recorder->keyframe_interval > 0 && recorder->ticks % recorder->keyframe_interval == 0) {
+    flush_run(recorder);
+    write_keyframe(recorder, game);
+  }
+}
+
+
+/**
+ * @brief Writes the end of the replay, with the score and the state of the game and the index of the keyframes, and
+ * closes it.
+ * @param recorder The recorder.
+ * @param game Pointer to the game instance, after the last command recorded.
+ * @return error `NO_ERROR`, or `CANNOT_WRITE_FILE` if any write failed.
+ */
+enum error replay_finish(struct replay_recorder *recorder, const struct game *game) {
+  uint8_t marker = REPLAY_END;
+
+  flush_run(recorder);
+  put_bytes(recorder, &marker, 1);
+
+  size_t footer = recorder->offset;
+
+  write_varint(recorder, (uint64_t) recorder->ticks);
+  write_varint(recorder, (uint64_t) game->score);
+  marker = (uint8_t) game->status;
+  put_bytes(recorder, &marker, 1);
+
+  write_varint(recorder, recorder->keyframes_count);
+
+  for (size_t i = 0; i < recorder->keyframes_count; i++) {
+    const struct keyframe *previous = i > 0 ? &recorder->keyframes[i - 1] : NULL;
+
+    write_varint(recorder, (uint64_t) (recorder->keyframes[i].tick - (previous ? previous->tick : 0)));
+    write_varint(recorder, recorder->keyframes[i].offset - (previous ? previous->offset : 0));
+  }
+
+  uint8_t bytes[TRAILER_SIZE];
+
+  for (int i = 0; i < TRAILER_SIZE; i++)
+    bytes[i] = (uint8_t) ((uint64_t) footer >> (8 * i));
+
+  put_bytes(recorder, bytes, sizeof(bytes));
+
+  bool failed = recorder->failed || ferror(recorder->fp);
+
+  if (fclose(recorder->fp) != 0)
+    failed = true;
+
+  free(recorder->keyframes);
+  memset(recorder, 0, sizeof(struct replay_recorder));
+
+  return failed ? CANNOT_WRITE_FILE : NO_ERROR;
+}
+
+
+/******************************************************************************/
+/* PLAYBACK                                                                   */
+
+/**
+ * @brief Reads the run of commands at an offset of the replay.
+ * @param replay The replay.
+ * @param offset Offset of the run, moved past it. It's not moved past a keyframe.
+ * @param command Where the command is written, or the marker of a keyframe or of the end of the runs.
+ * @param length Where the length of the run is written.
+ * @return bool Returns `false` when the run is not valid.
+ */
+bool read_run(const struct replay *replay, size_t *offset, int *command, uint64_t *length) {
+  if (*offset >= replay->footer)
+    return false;
+
+  uint8_t byte = replay->data[(*offset)++];
+
+  *command = byte & MARKER_MASK;
+  *length = (uint64_t) (byte >> 3) + 1;
+
+  if (*command == REPLAY_KEYFRAME || *command == REPLAY_END)
+    return true;
+
+  if (*command > ANTICLOCKWISE_ROTATION)
+    return false;
+
+  if (*length == MAX_SHORT_RUN + 1) {
+    uint64_t rest;
+
+    if (!read_varint(replay->data, replay->footer, offset, &rest) || rest > LLONG_MAX / 2)
+      return false;
+
+    *length += rest;
+  }
+
+  return true;
+}
+
+
+/**
+ * @brief Plays the runs of commands of a replay from an offset, up to a tick.
+ * @param replay The replay.
+ * @param game Pointer to the game instance, which must be in the state of the replay at the tick `from`.
+ * @param offset Offset of the first run to play.
+ * @param from The tick of the game.
+ * @param to The tick to reach.
+ * @param verify Plays up to the end marker, which must come exactly at `to`, and checks that every keyframe met on
+ * the way has the state of the game played so far, and that no command comes once the game is over.
+ * @return error `NO_ERROR`, or `INVALID_REPLAY` if the runs are not valid, end before `to`, a keyframe is wrong, or the
+ * game is played past its end.
+ */
+enum error play_runs(const struct replay *replay, struct game *game, size_t offset, long long from, long long to,
+                     bool verify) {
+  long long tick = from;
+  int command;
+  uint64_t length;
+
+  while (verify || tick < to) {
+    if (!read_run(replay, &offset, &command, &length))
+      return INVALID_REPLAY;
+
+    if (command == REPLAY_END)
+      return tick == to ? NO_ERROR : INVALID_REPLAY;
+
+    if (command == REPLAY_KEYFRAME) {
+      struct game keyframe;
+      uint8_t buffer[KEYFRAME_MAX_SIZE];
+      size_t start = offset;
+
+      if (!decode_keyframe(replay->data, replay->footer, &offset, &keyframe))
+        return INVALID_REPLAY;
+
+      if (verify &&
+          (offset - start != encode_keyframe(game, buffer) || memcmp(buffer, replay->data + start, offset - start)))
+        return INVALID_REPLAY;
+
+      continue;
+    }
+
+    long long count = (long long) length < to - tick ? (long long) length : to - tick;
+
+    // When verifying, the runs cannot go past the ticks in the footer.
+    if (verify && count < (long long) length)
+      return INVALID_REPLAY;
+
+    for (long long i = 0; i < count; i++) {
+      // A game over cannot go on, even if the engine would let a command bring it back to life.
+      if (verify && game->status != RUNNING)
+        return INVALID_REPLAY;
+
+      execute(game, (enum command) command);
+    }
+
+    tick += count;
+  }
+
+  return NO_ERROR;
+}
+
+
+/**
+ * @brief Parses the header, the footer and the index of a replay. The runs of commands are checked while playing them.
+ * @param replay The replay, whose data is already read.
+ * @return bool Returns `false` when the replay is not valid.
+ */
+bool parse_replay(struct replay *replay) {
+  const uint8_t *data = replay->data;
+  size_t size = replay->size;
+  size_t magic_size = strlen(REPLAY_MAGIC);
+  size_t offset = magic_size + 2;
+  uint64_t value;
+
+  if (size < offset + TRAILER_SIZE || memcmp(data, REPLAY_MAGIC, magic_size) != 0 ||
+      data[magic_size] != REPLAY_VERSION)
+    return false;
+
+  // The footer, found through the trailer, must follow the end marker.
+  size -= TRAILER_SIZE;
+  replay->footer = 0;
+
+  for (int i = 0; i < TRAILER_SIZE; i++)
+    replay->footer |= (size_t) data[size + i] << (8 * i);
+
+  if (replay->footer <= offset || replay->footer >= size || data[replay->footer - 1] != REPLAY_END)
+    return false;
+
+  replay->difficulty = data[magic_size + 1];
+
+  if (replay->difficulty == BOARD_FILE) {
+    replay->difficulty = -1;
+
+    if (!read_varint(data, replay->footer, &offset, &value) || value > replay->footer - offset)
+      return false;
+
+    replay->board = data + offset;
+    replay->board_size = (size_t) value;
+    offset += replay->board_size;
+  }
+
+  if (replay->footer - offset < 9)
+    return false;
+
+  replay->seed = 0;
+
+  for (int i = 0; i < 8; i++)
+    replay->seed |= (uint64_t) data[offset++] << (8 * i);
+
+  replay->commands = offset;
+  offset = replay->footer;
+
+  if (!read_varint(data, size, &offset, &value) || value > LLONG_MAX / 2)
+    return false;
+
+  replay->ticks = (long long) value;
+
+  if (!read_int(data, size, &offset, &replay->score) || offset >= size || data[offset] > DEFEAT)
+    return false;
+
+  replay->status = (enum state) data[offset++];
+
+  if (!read_varint(data, size, &offset, &value) || value > (replay->footer - replay->commands) / 2)
+    return false;
+
+  replay->keyframes_count = (size_t) value;
+  replay->keyframes = malloc((replay->keyframes_count + 1) * sizeof(struct keyframe));
+
+  if (!replay->keyframes)
+    return false;
+
+  long long tick = 0;
+  size_t position = 0;
+
+  // The keyframes must be in order, inside the runs, and each one must be marked as such.
+  for (size_t i = 0; i < replay->keyframes_count; i++) {
+    uint64_t ticks, bytes;
+
+    if (!read_varint(data, size, &offset, &ticks) || !read_varint(data, size, &offset, &bytes) ||
+        ticks > (uint64_t) (replay->ticks - tick) || bytes > replay->footer - position)
+      return false;
+
+    tick += (long long) ticks;
+    position += bytes;
+
+    if (position < replay->commands || position >= replay->footer - 1 || data[position] != REPLAY_KEYFRAME ||
+        (i > 0 && bytes == 0))
+      return false;
+
+    replay->keyframes[i] = (struct keyframe) { tick, position };
+  }
+
+  return offset == size;
+}
+
+
+/**
+ * @brief Reads a replay.
+ * @param replay The replay, released with `replay_free()`.
+ * @param path The filepath of the replay.
+ * @return error `NO_ERROR`, or the reason why the replay could not be read.
+ */
+enum error replay_load(struct replay *replay, const char *path) {
+  memset(replay, 0, sizeof(struct replay));
+
+  FILE *fp = fopen(path, "rb");
+
+  if (!fp)
+    return CANNOT_OPEN_FILE;
+
+  size_t capacity = 4096;
+  replay->data = malloc(capacity);
+
+  while (replay->data) {
+    replay->size += fread(replay->data + replay->size, 1, capacity - replay->size, fp);
+
+    if (replay->size < capacity)
+      break;
+
+    capacity *= 2;
+    uint8_t *data = realloc(replay->data, capacity);
+
+    if (!data)
+      free(replay->data);
+
+    replay->data = data;
+  }
+
+  bool failed = !replay->data || ferror(fp);
+  fclose(fp);
+
+  if (failed) {
+    replay_free(replay);
+    return CANNOT_OPEN_FILE;
+  }
+
+  if (!parse_replay(replay)) {
+    replay_free(replay);
+    return INVALID_REPLAY;
+  }
+
+  return NO_ERROR;
+}
+
+
+/**
+ * @brief Initializes a game as it was when the replay was recorded, before the first command.
+ * @param replay The replay.
+ * @param game Pointer to the game instance.
+ * @return error `NO_ERROR`, or the reason why the grid could not be filled or loaded.
+ */
+enum error replay_start(const struct replay *replay, struct game *game) {
+  init_game(game, replay->seed);
+
+  if (replay->difficulty >= 0)
+    return fill_grid(game, replay->difficulty);
+
+  // The layout is loaded like the file it came from, so the generator draws the same colors for the viruses to change.
+  FILE *fp = fmemopen((void *) replay->board, replay->board_size, "r");
+
+  if (!fp)
+    return INVALID_REPLAY;
+
+  enum error error = read_grid(game, fp, "replay");
+  fclose(fp);
+
+  return error;
+}
+
+
+/**
+ * @brief Plays a replay from the start to the end, as fast as possible. The keyframes are not trusted: each of them
+ * is checked against the game played so far.
+ * @param replay The replay.
+ * @param game Pointer to the game instance, which has the final state of the game on return.
+ * @param ticks Where the number of ticks played is written.
+ * @return error `NO_ERROR`, or the reason why the replay could not be played to the end.
+ */
+enum error replay_play(const struct replay *replay, struct game *game, long long *ticks) {
+  enum error error = replay_start(replay, game);
+
+  *ticks = 0;
+
+  if (error != NO_ERROR)
+    return error;
+
+  error = play_runs(replay, game, replay->commands, 0, replay->ticks, true);
+
+  if (error == NO_ERROR)
+    *ticks = replay->ticks;
+
+  return error;
+}
+
+
+/**
+ * @brief Brings a game to a tick of the replay, starting from the last keyframe before it.
+ * @param replay The replay.
+ * @param game Pointer to the game instance.
+ * @param tick The tick, between 0 and the ticks of the replay.
+ * @return error `NO_ERROR`, or the reason why the tick could not be reached.
+ */
+enum error replay_seek(const struct replay *replay, struct game *game, long long tick) {
+  if (tick < 0 || tick > replay->ticks)
+    return INVALID_REPLAY;
+
+  // Finds the last keyframe which is not after the tick.
+  size_t low = 0, high = replay->keyframes_count;
+
+  while (low < high) {
+    size_t middle = low + (high - low) / 2;
+
+    if (replay->keyframes[middle].tick <= tick)
+      low = middle + 1;
+    else
+      high = middle;
+  }
+
+  if (low == 0) {
+    enum error error = replay_start(replay, game);
+
+    return error != NO_ERROR ? error : play_runs(replay, game, replay->commands, 0, tick, false);
+  }
+
+  const struct keyframe *keyframe = &replay->keyframes[low - 1];
+  size_t offset = keyframe->offset + 1;
+
+  init_game(game, replay->seed);
+
+  if (!decode_keyframe(replay->data, replay->footer, &offset, game))
+    return INVALID_REPLAY;
+
+  return play_runs(replay, game, offset, keyframe->tick, tick, false);
+}
+
+
+/**
+ * @brief Releases a replay.
+ * @param replay The replay.
+ */
+void replay_free(struct replay *replay) {
+  free(replay->data);
+  free(replay->keyframes);
+  memset(replay, 0, sizeof(struct replay));
+}
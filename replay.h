@@ -0,0 +1,86 @@
+#ifndef REPLAY_H
+#define REPLAY_H
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include "drmauro.h"
+
+#define REPLAY_MAGIC "DRMR"
+#define REPLAY_VERSION 2
+#define KEYFRAME_MAX_SIZE 512
+
+
+/**
+ * A replay stores what's needed to play a game again: the seed, the difficulty or the layout of the board file, and the
+ * commands passed to `execute()` at every tick, run-length encoded. Every few ticks it also stores a keyframe, the whole
+ * state of the game, so that a tick can be reached without playing all the previous ones. Its footer has the score and
+ * the state claimed at the end of the game, so that a player can check them, and the index of the keyframes.
+ *
+ * The file is made of:
+ *   - the magic `DRMR` and the version, one byte;
+ *   - the difficulty, one byte, `0xff` when the grid was loaded from a file, followed by the size of the file as a
+ *     varint and its content;
+ *   - the seed, 8 bytes little-endian;
+ *   - the runs of commands: a byte with the command in the low 3 bits and the length of the run minus one in the high 5
+ *     bits; when they are all set, a varint follows with the rest of the length;
+ *   - among the runs, the keyframes: a byte with `REPLAY_KEYFRAME` in the low 3 bits and the state of the game after
+ *     the ticks played so far;
+ *   - the end marker, a byte with `REPLAY_END` in the low 3 bits;
+ *   - the footer: the ticks and the score as varints, then the state, one byte;
+ *   - the index: the number of keyframes, then the tick and the offset of each of them, as varints of the difference
+ *     from the previous one;
+ *   - the offset of the footer, 8 bytes little-endian, so the index is found without reading the runs.
+ */
+enum replay_marker { REPLAY_KEYFRAME = 6, REPLAY_END = 7 };
+
+struct keyframe {
+  long long tick;
+  size_t offset;
+};
+
+struct replay_recorder {
+  FILE *fp;
+  size_t offset;
+  enum command command;
+  long long run;
+  long long ticks;
+  int keyframe_interval;
+  struct keyframe *keyframes;
+  size_t keyframes_count;
+  size_t keyframes_capacity;
+  bool failed;
+};
+
+struct replay {
+  uint8_t *data;
+  size_t size;
+  uint64_t seed;
+  int difficulty;
+  const uint8_t *board;
+  size_t board_size;
+  size_t commands;
+  size_t footer;
+  long long ticks;
+  int score;
+  enum state status;
+  struct keyframe *keyframes;
+  size_t keyframes_count;
+};
+
+
+enum error replay_create(struct replay_recorder *recorder, const char *path, uint64_t seed, int difficulty,
+                         const char *board_file, int keyframe_interval);
+void replay_record(struct replay_recorder *recorder, const struct game *game, enum command command);
+enum error replay_finish(struct replay_recorder *recorder, const struct game *game);
+
+enum error replay_load(struct replay *replay, const char *path);
+enum error replay_start(const struct replay *replay, struct game *game);
+enum error replay_play(const struct replay *replay, struct game *game, long long *ticks);
+enum error replay_seek(const struct replay *replay, struct game *game, long long tick);
+void replay_free(struct replay *replay);
+
+size_t encode_keyframe(const struct game *game, uint8_t *buffer);
+bool decode_keyframe(const uint8_t *data, size_t size, size_t *offset, struct game *game);
+
+#endif
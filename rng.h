@@ -0,0 +1,115 @@
+#ifndef RNG_H
+#define RNG_H
+
+#include <stdint.h>
+
+
+/**
+ * A xoshiro128** pseudo-random generator. Every game owns one, so that a game is entirely determined by its seed and
+ * by the commands it receives, whatever else happens in the process.
+ * @see https://prng.di.unimi.it
+ */
+struct rng {
+  uint32_t state[4];
+};
+
+
+static inline uint32_t rng_rotl(uint32_t x, int k) {
+  return (x << k) | (x >> (32 - k));
+}
+
+
+/**
+ * @brief Returns the next value of the splitmix64 sequence, used to spread a seed over the whole state.
+ */
+static inline uint64_t rng_splitmix64(uint64_t *x) {
+  uint64_t z = (*x += UINT64_C(0x9e3779b97f4a7c15));
+
+  z = (z ^ (z >> 30)) * UINT64_C(0xbf58476d1ce4e5b9);
+  z = (z ^ (z >> 27)) * UINT64_C(0x94d049bb133111eb);
+
+  return z ^ (z >> 31);
+}
+
+
+/**
+ * @brief Initializes the generator from a seed. Any seed is valid, zero included.
+ */
+static inline void rng_seed(struct rng *rng, uint64_t seed) {
+  uint64_t a = rng_splitmix64(&seed);
+  uint64_t b = rng_splitmix64(&seed);
+
+  rng->state[0] = (uint32_t) a;
+  rng->state[1] = (uint32_t) (a >> 32);
+  rng->state[2] = (uint32_t) b;
+  rng->state[3] = (uint32_t) (b >> 32);
+}
+
+
+/**
+ * @brief Returns the next 32 random bits.
+ */
+static inline uint32_t rng_next(struct rng *rng) {
+  uint32_t *s = rng->state;
+  const uint32_t result = rng_rotl(s[1] * 5, 7) * 9;
+  const uint32_t t = s[1] << 9;
+
+  s[2] ^= s[0];
+  s[3] ^= s[1];
+  s[1] ^= s[2];
+  s[0] ^= s[3];
+  s[2] ^= t;
+  s[3] = rng_rotl(s[3], 11);
+
+  return result;
+}
+
+
+/**
+ * @brief Returns a random number between 0 and `bound - 1`, with no bias. `bound` must be greater than zero.
+ * @details Uses Lemire's multiply and shift, which rejects a draw only in the rare case it falls in the uneven part of
+ * the range.
+ * @see https://arxiv.org/abs/1805.10941
+ */
+static inline uint32_t rng_below(struct rng *rng, uint32_t bound) {
+  uint64_t m = (uint64_t) rng_next(rng) * bound;
+  uint32_t low = (uint32_t) m;
+
+  if (low < bound) {
+    const uint32_t threshold = -bound % bound;
+
+    while (low < threshold) {
+      m = (uint64_t) rng_next(rng) * bound;
+      low = (uint32_t) m;
+    }
+  }
+
+  return (uint32_t) (m >> 32);
+}
+
+
+/**
+ * @brief Advances the generator by 2^64 draws.
+ * @details It's used to split a sequence into independent streams: a copy of the generator taken before each jump
+ * yields 2^64 values which overlap with none of the others.
+ */
+static inline void rng_jump(struct rng *rng) {
+  static const uint32_t jump[] = { 0x8764000b, 0xf542d2d3, 0x6fa035c3, 0x77f2db5b };
+  uint32_t s[4] = { 0, 0, 0, 0 };
+
+  for (int i = 0; i < 4; i++)
+    for (int b = 0; b < 32; b++) {
+      if (jump[i] & (UINT32_C(1) << b)) {
+        s[0] ^= rng->state[0];
+        s[1] ^= rng->state[1];
+        s[2] ^= rng->state[2];
+        s[3] ^= rng->state[3];
+      }
+      rng_next(rng);
+    }
+
+  for (int i = 0; i < 4; i++)
+    rng->state[i] = s[i];
+}
+
+#endif
@@ -0,0 +1,235 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "transposition.h"
+
+#define VALID_ENTRY (1ull << 24)
+#define GENERATION_SHIFT 32
+
+
+/******************************************************************************/
+/* ENTRIES                                                                    */
+
+/**
+ * @brief Packs the depth, the placement and the generation of an entry in a word, the generation in the upper half.
+ * @param transposition The transposition.
+ * @param generation The generation.
+ * @return uint64_t
+ */
+uint64_t pack_entry_data(const struct transposition *transposition, uint32_t generation) {
+  int depth = transposition->depth < 0 ? 0 : transposition->depth > UINT8_MAX ? UINT8_MAX : transposition->depth;
+
+  return (uint64_t) generation << GENERATION_SHIFT | VALID_ENTRY | (uint64_t) depth << 16 |
+         (uint64_t) (uint16_t) transposition->placement;
+}
+
+
+/**
+ * @brief Reads an entry of the table.
+ * @details The words are read one by one, while other threads may be writing them: the entry is only trusted if its
+ * check matches the key.
+ * @param entry The entry.
+ * @param key The key.
+ * @param data Receives the data of the entry, even if it does not match the key, `0` for an empty entry.
+ * @param value Receives the value of the entry, even if it does not match the key.
+ * @return bool Returns `true` if the entry holds the key.
+ */
+bool read_entry(const struct table_entry *entry, uint64_t key, uint64_t *data, uint64_t *value) {
+  uint64_t check = atomic_load_explicit(&entry->check, memory_order_relaxed);
+
+  *value = atomic_load_explicit(&entry->value, memory_order_relaxed);
+  *data = atomic_load_explicit(&entry->data, memory_order_relaxed);
+
+  return (*data & VALID_ENTRY) && (check ^ *value ^ *data) == key;
+}
+
+
+/**
+ * @brief Writes an entry of the table.
+ * @param entry The entry.
+ * @param key The key.
+ * @param data The data of the entry.
+ * @param value The value of the entry.
+ */
+void write_entry(struct table_entry *entry, uint64_t key, uint64_t data, uint64_t value) {
+  atomic_store_explicit(&entry->check, key ^ value ^ data, memory_order_relaxed);
+  atomic_store_explicit(&entry->value, value, memory_order_relaxed);
+  atomic_store_explicit(&entry->data, data, memory_order_relaxed);
+}
+
+
+/**
+ * @brief Returns how much an entry is worth keeping: the empty ones the least, then the ones of older generations,
+ * then the ones searched least deep.
+ * @param data The data of the entry.
+ * @param generation The current generation.
+ * @return int
+ */
+int get_entry_priority(uint64_t data, uint32_t generation) {
+  if (!(data & VALID_ENTRY))
+    return -1;
+
+  return ((uint32_t) (data >> GENERATION_SHIFT) == generation ? 256 : 0) + (int) (uint8_t) (data >> 16);
+}
+
+
+/******************************************************************************/
+/* TABLE                                                                      */
+
+/**
+ * @brief Allocates an empty table.
+ * @param table The table.
+ * @param size The size of the table in bytes, rounded down to a power of two buckets, at least one.
+ * @return bool Returns `false` if there is no memory.
+ */
+bool init_transposition_table(struct transposition_table *table, size_t size) {
+  uint64_t buckets = 1;
+
+  while (buckets * 2 * sizeof(struct table_bucket) <= size)
+    buckets *= 2;
+
+  table->buckets = aligned_alloc(_Alignof(struct table_bucket), buckets * sizeof(struct table_bucket));
+  table->mask = buckets - 1;
+  table->generation = 0;
+
+  if (!table->buckets)
+    return false;
+
+  clear_transposition_table(table);
+
+  return true;
+}
+
+
+/**
+ * @brief Gives back the memory of a table.
+ * @param table The table.
+ */
+void free_transposition_table(struct transposition_table *table) {
+  free(table->buckets);
+  table->buckets = NULL;
+}
+
+
+/**
+ * @brief Empties a table. No other thread must be using it.
+ * @param table The table.
+ */
+void clear_transposition_table(struct transposition_table *table) {
+  memset(table->buckets, 0, (table->mask + 1) * sizeof(struct table_bucket));
+  table->generation = 0;
+}
+
+
+/**
+ * @brief Starts a new generation of the table, before a search: the entries stored until then are replaced first.
+ * No other thread must be using the table.
+ * @details The generations take 32 bits, so they only wrap after billions of searches; the table is emptied then, so
+ * that an old entry never reads as current.
+ * @param table The table.
+ */
+void age_transposition_table(struct transposition_table *table) {
+  if (++table->generation == 0)
+    clear_transposition_table(table);
+}
+
+
+/**
+ * @brief Looks for a key in a table.
+ * @param table The table.
+ * @param key The key.
+ * @param transposition Receives what the table knows about the key, if it's found.
+ * @param stats Counts the probe as a hit or a miss, unless `NULL`.
+ * @return bool Returns `true` if the key is found.
+ */
+bool probe_transposition(const struct transposition_table *table, uint64_t key, struct transposition *transposition,
+                         struct table_stats *stats) {
+  const struct table_bucket *bucket = &table->buckets[key & table->mask];
+
+  for (int i = 0; i < TABLE_BUCKET_ENTRIES; i++) {
+    uint64_t data, value;
+
+    if (read_entry(&bucket->entries[i], key, &data, &value)) {
+      memcpy(&transposition->value, &value, sizeof(double));
+      transposition->depth = (uint8_t) (data >> 16);
+      transposition->placement = (int16_t) (uint16_t) data;
+      transposition->current = (uint32_t) (data >> GENERATION_SHIFT) == table->generation;
+
+      if (stats)
+        stats->hits++;
+
+      return true;
+    }
+  }
+
+  if (stats)
+    stats->misses++;
+
+  return false;
+}
+
+
+/**
+ * @brief Stores what is known about a key in a table.
+ * @details If the key is already in the table, its entry is only replaced by one searched at least as deep, unless it
+ * is from an older generation. Otherwise the key takes the entry of its bucket worth the least, as told by
+ * `get_entry_priority()`.
+ * @param table The table.
+ * @param key The key.
+ * @param transposition What is known about the key; `current` is ignored.
+ * @param stats Counts the store, and the collision if any, unless `NULL`.
+ */
+void store_transposition(struct transposition_table *table, uint64_t key, const struct transposition *transposition,
+                         struct table_stats *stats) {
+  struct table_bucket *bucket = &table->buckets[key & table->mask];
+  uint64_t data = pack_entry_data(transposition, table->generation);
+  uint64_t value;
+  struct table_entry *victim = NULL;
+  int priority = INT32_MAX;
+
+  memcpy(&value, &transposition->value, sizeof(double));
+
+  for (int i = 0; i < TABLE_BUCKET_ENTRIES; i++) {
+    struct table_entry *entry = &bucket->entries[i];
+    uint64_t old_data, old_value;
+
+    if (read_entry(entry, key, &old_data, &old_value)) {
+      if ((uint32_t) (old_data >> GENERATION_SHIFT) == table->generation &&
+          (uint8_t) (old_data >> 16) > (uint8_t) (data >> 16))
+        return;
+
+      victim = entry;
+      priority = -1;
+      break;
+    }
+
+    int entry_priority = get_entry_priority(old_data, table->generation);
+
+    if (entry_priority < priority) {
+      victim = entry;
+      priority = entry_priority;
+    }
+  }
+
+  if (stats) {
+    stats->stores++;
+
+    if (priority >= 256)
+      stats->collisions++;
+  }
+
+  write_entry(victim, key, data, value);
+}
+
+
+/**
+ * @brief Adds the counters of a thread to a total.
+ * @param total The total.
+ * @param stats The counters.
+ */
+void add_table_stats(struct table_stats *total, const struct table_stats *stats) {
+  total->hits += stats->hits;
+  total->misses += stats->misses;
+  total->stores += stats->stores;
+  total->collisions += stats->collisions;
+}
@@ -0,0 +1,74 @@
+#ifndef TRANSPOSITION_H
+#define TRANSPOSITION_H
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define TABLE_BUCKET_ENTRIES 2
+
+
+/**
+ * What the table knows about a game: its `value`, the pills searched beyond it (`depth`), and the best `placement` of
+ * its pill found, as a state of the pill, or `-1`. `current` tells whether it was stored in the current generation,
+ * that is during the current search.
+ */
+struct transposition {
+  double value;
+  int depth;
+  int placement;
+  bool current;
+};
+
+/**
+ * An entry of the table. The threads read and write its words without locks: `check` is the key xored with the other
+ * words, so that an entry torn by two threads writing it at the same time does not match any key, and reads as empty.
+ */
+struct table_entry {
+  _Atomic uint64_t check;
+  _Atomic uint64_t value;
+  _Atomic uint64_t data;
+  uint64_t padding;
+};
+
+/**
+ * A bucket of entries, filling a cache line: a key can only be stored in the bucket given by its lowest bits.
+ */
+struct table_bucket {
+  _Alignas(64) struct table_entry entries[TABLE_BUCKET_ENTRIES];
+};
+
+/**
+ * A transposition table of fixed size, shared among threads, keyed by `game_hash()` or any other 64 bit hash.
+ * When a bucket is full a new key replaces its entry from the oldest generation, then the one searched least deep.
+ */
+struct transposition_table {
+  struct table_bucket *buckets;
+  uint64_t mask;
+  uint32_t generation;
+};
+
+/**
+ * What the table did for a thread: the probes which found their key and the ones which did not, the entries stored,
+ * and the collisions, the stores which had to replace an entry of another key from the current generation.
+ */
+struct table_stats {
+  long long hits;
+  long long misses;
+  long long stores;
+  long long collisions;
+};
+
+
+bool init_transposition_table(struct transposition_table *table, size_t size);
+void free_transposition_table(struct transposition_table *table);
+void clear_transposition_table(struct transposition_table *table);
+void age_transposition_table(struct transposition_table *table);
+bool probe_transposition(const struct transposition_table *table, uint64_t key, struct transposition *transposition,
+                         struct table_stats *stats);
+void store_transposition(struct transposition_table *table, uint64_t key, const struct transposition *transposition,
+                         struct table_stats *stats);
+void add_table_stats(struct table_stats *total, const struct table_stats *stats);
+
+#endif